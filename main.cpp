@@ -6,21 +6,149 @@
 #include <map>
 #include <queue>
 #include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <string>
+#include <tuple>
+#include <cstdint>
+#include <cmath>
+#include <memory>
+#include <deque>
+#include <list>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstring>
+#include <random>
+#include <cassert>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
 enum GameState { MAIN_MENU, PLAYING, FINISHED };
+enum GameMode { CLASSIC, DYNAMIC_WALLS, RACE, CHASE, KEYS, COINS, EXPLORE, GAME_MODE_COUNT };
+const char* const GAME_MODE_NAMES[] = {"Classic", "Doors", "Race", "Chase", "Keys", "Coins", "Explore"};
 const int TILE_SIZE = 48;
+const int TILE_VARIANTS = 4;
 const int VIEW_RADIUS = 6;
+const int EXPLORE_REPAIR_BUDGET = 50000;
+const int MINIMAP_SIZE = 240;
+const size_t MAX_OVERVIEW_PATCH = 4096;
+const float LOD_CELL_PIXELS = 4.0f;
+const float FRAME_BUDGET_MS = 1000.f / 60;
+const int MAX_PIXEL_SCALE = 4;
 const int WALL = 0, PASS = 1;
 
+enum PathBackend { BFS, ASTAR, JPS };
+
+enum Terrain { ROAD, FLOOR, MUD, WATER };
+const int TERRAIN_COST[] = {1, 2, 4, 8};
+const int MAX_TERRAIN_COST = 15;
+const float MOVE_DELAY_PER_COST = 0.075f;
+const sf::Color TERRAIN_COLOR[] = {
+    sf::Color(230, 210, 160), sf::Color(255, 255, 255), sf::Color(150, 110, 70), sf::Color(90, 150, 230)
+};
+
+// Item codes keep the key colour in the low bits.
+const int NO_ITEM = 0, KEY_ITEM = 0x10, LOCK_ITEM = 0x20, COIN_ITEM = 0x30, ITEM_COLOR_MASK = 0x0F;
+const int SLIME_FRAMES = 6, CIRCLE_SLOT = 6, SQUARE_SLOT = 7, ENTITY_SLOTS = 8;
+const int MAX_KEYS = 8;
+const sf::Color KEY_COLORS[MAX_KEYS] = {
+    sf::Color(230, 40, 40), sf::Color(40, 90, 230), sf::Color(240, 200, 20), sf::Color(150, 60, 200),
+    sf::Color(250, 130, 20), sf::Color(20, 200, 200), sf::Color(230, 80, 180), sf::Color(110, 70, 30)
+};
+
+// Render target that counts the draw calls issued through it, for the F3 stats line.
+template <typename Target>
+class Counting : public Target {
+private:
+    int drawCalls = 0;
+
+public:
+    using Target::Target;
+
+    int getDrawCalls() const { return drawCalls; }
+    void resetDrawCalls() { drawCalls = 0; }
+
+    void draw(const sf::Drawable& drawable, const sf::RenderStates& states = sf::RenderStates::Default) {
+        drawCalls++;
+        Target::draw(drawable, states);
+    }
+
+    void draw(const sf::Vertex* vertices, size_t count, sf::PrimitiveType type,
+              const sf::RenderStates& states = sf::RenderStates::Default) {
+        drawCalls++;
+        Target::draw(vertices, count, type, states);
+    }
+
+    void draw(const sf::VertexBuffer& buffer, const sf::RenderStates& states = sf::RenderStates::Default) {
+        drawCalls++;
+        Target::draw(buffer, states);
+    }
+
+    void draw(const sf::VertexBuffer& buffer, size_t first, size_t count,
+              const sf::RenderStates& states = sf::RenderStates::Default) {
+        drawCalls++;
+        Target::draw(buffer, first, count, states);
+    }
+};
+
+using CountingWindow = Counting<sf::RenderWindow>;
+using CountingTexture = Counting<sf::RenderTexture>;
+
+sf::IntRect visibleCellRect(const sf::View& camera, int width, int height) {
+    sf::Vector2f corner = camera.getCenter() - camera.getSize() / 2.f;
+    int x0 = max(0, (int)floor(corner.x / TILE_SIZE));
+    int y0 = max(0, (int)floor(corner.y / TILE_SIZE));
+    int x1 = min(width - 1, (int)floor((corner.x + camera.getSize().x) / TILE_SIZE));
+    int y1 = min(height - 1, (int)floor((corner.y + camera.getSize().y) / TILE_SIZE));
+    return sf::IntRect(x0, y0, max(0, x1 - x0 + 1), max(0, y1 - y0 + 1));
+}
+
+class BitGrid {
+private:
+    int width, height;
+    vector<uint64_t> words;
+
+public:
+    BitGrid(int w = 0, int h = 0) : width(w), height(h), words((static_cast<size_t>(w) * h + 63) / 64, 0) {}
+
+    bool test(int index) const { return words[index >> 6] >> (index & 63) & 1; }
+    void set(int index) { words[index >> 6] |= uint64_t(1) << (index & 63); }
+    void reset(int index) { words[index >> 6] &= ~(uint64_t(1) << (index & 63)); }
+
+    bool test(int x, int y) const { return test(y * width + x); }
+    void set(int x, int y) { set(y * width + x); }
+    void reset(int x, int y) { reset(y * width + x); }
+
+    void clear() { fill(words.begin(), words.end(), 0); }
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+};
+
+class MazeListener {
+public:
+    virtual ~MazeListener() = default;
+    virtual void onCellChanged(int x, int y) = 0;
+};
+
 class Maze {
 private:
     int** maze;
     int width, height;
+    vector<uint8_t> terrain;
+    vector<uint8_t> items;
+    vector<uint8_t> variants;
+    vector<MazeListener*> listeners;
+    unsigned seed = 0;
 
 public:
-    Maze(int w, int h) : width(w), height(h) {
+    Maze(int w, int h) : width(w), height(h), terrain(w * h, FLOOR), items(w * h, NO_ITEM), variants(w * h, 0) {
         maze = new int*[height];
         for (int i = 0; i < height; ++i)
             maze[i] = new int[width];
@@ -37,9 +165,32 @@ public:
         return maze[y][x];
     }
 
+    const int* row(int y) const { return maze[y]; }
+
+    // Copies cells, terrain, items and variants from a maze of the same size, without notifying listeners.
+    void copyFrom(const Maze& other) {
+        for (int i = 0; i < height; ++i)
+            copy(other.maze[i], other.maze[i] + width, maze[i]);
+        terrain = other.terrain;
+        items = other.items;
+        variants = other.variants;
+        seed = other.seed;
+    }
+
     void set(int x, int y, int value) {
-        if (x >= 0 && y >= 0 && x < width && y < height)
+        if (x >= 0 && y >= 0 && x < width && y < height && maze[y][x] != value) {
             maze[y][x] = value;
+            for (MazeListener* listener : listeners)
+                listener->onCellChanged(x, y);
+        }
+    }
+
+    void subscribe(MazeListener* listener) {
+        listeners.push_back(listener);
+    }
+
+    void unsubscribe(MazeListener* listener) {
+        listeners.erase(remove(listeners.begin(), listeners.end(), listener), listeners.end());
     }
 
     bool isWall(int x, int y) const {
@@ -49,6 +200,57 @@ public:
     int getWidth() const { return width; }
     int getHeight() const { return height; }
 
+    Terrain getTerrain(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) return FLOOR;
+        return static_cast<Terrain>(terrain[y * width + x]);
+    }
+
+    void setTerrain(int x, int y, Terrain value) {
+        if (x >= 0 && y >= 0 && x < width && y < height)
+            terrain[y * width + x] = value;
+    }
+
+    unsigned getSeed() const { return seed; }
+
+    // Variants are kept per state, wall + TILE_VARIANTS * floor, so a door shows the right one
+    // whichever way it is toggled.
+    int getVariant(int x, int y) const {
+        int both = variants[y * width + x];
+        return isWall(x, y) ? both % TILE_VARIANTS : both / TILE_VARIANTS;
+    }
+
+    void setVariants(vector<uint8_t> values) {
+        variants = move(values);
+    }
+
+    int getCost(int x, int y) const {
+        return TERRAIN_COST[getTerrain(x, y)];
+    }
+
+    int getItem(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) return NO_ITEM;
+        return items[y * width + x];
+    }
+
+    void setItem(int x, int y, int value) {
+        if (x >= 0 && y >= 0 && x < width && y < height && items[y * width + x] != value) {
+            items[y * width + x] = value;
+            for (MazeListener* listener : listeners)
+                listener->onCellChanged(x, y);
+        }
+    }
+
+    int keyAt(int x, int y) const {
+        int item = getItem(x, y);
+        return (item & ~ITEM_COLOR_MASK) == KEY_ITEM ? 1 << (item & ITEM_COLOR_MASK) : 0;
+    }
+
+    bool isPassable(int x, int y, int keys) const {
+        if (isWall(x, y)) return false;
+        int item = items[y * width + x];
+        return (item & ~ITEM_COLOR_MASK) != LOCK_ITEM || (keys >> (item & ITEM_COLOR_MASK) & 1);
+    }
+
     bool isDeadEnd(int x, int y) const {
         int a = 0;
         if (x != 1 && get(x - 2, y) == PASS) a++; else if (x == 1) a++;
@@ -59,32 +261,38 @@ public:
     }
 
     void generate() {
+        seed = rand();
         for (int i = 0; i < height; ++i)
             for (int j = 0; j < width; ++j)
                 maze[i][j] = WALL;
+        fill(terrain.begin(), terrain.end(), FLOOR);
+        fill(items.begin(), items.end(), NO_ITEM);
 
-        int x = 3, y = 3, a = 0;
-        while (a < 10000) {
-            maze[y][x] = PASS; a++;
+        // Keep walking until every odd cell is carved, so large boards come out as perfect mazes too.
+        const int cells = ((width - 1) / 2) * ((height - 1) / 2);
+        int x = 3, y = 3, carved = 0;
+        while (carved < cells) {
+            if (maze[y][x] == WALL) carved++;
+            maze[y][x] = PASS;
             while (true) {
                 int c = rand() % 4;
                 switch (c) {
                     case 0: if (y != 1 && maze[y - 2][x] == WALL) {
-                        maze[y - 1][x] = PASS; maze[y - 2][x] = PASS; y -= 2;
+                        maze[y - 1][x] = PASS; maze[y - 2][x] = PASS; y -= 2; carved++;
                     } break;
                     case 1: if (y != height - 2 && maze[y + 2][x] == WALL) {
-                        maze[y + 1][x] = PASS; maze[y + 2][x] = PASS; y += 2;
+                        maze[y + 1][x] = PASS; maze[y + 2][x] = PASS; y += 2; carved++;
                     } break;
                     case 2: if (x != 1 && maze[y][x - 2] == WALL) {
-                        maze[y][x - 1] = PASS; maze[y][x - 2] = PASS; x -= 2;
+                        maze[y][x - 1] = PASS; maze[y][x - 2] = PASS; x -= 2; carved++;
                     } break;
                     case 3: if (x != width - 2 && maze[y][x + 2] == WALL) {
-                        maze[y][x + 1] = PASS; maze[y][x + 2] = PASS; x += 2;
+                        maze[y][x + 1] = PASS; maze[y][x + 2] = PASS; x += 2; carved++;
                     } break;
                 }
                 if (isDeadEnd(x, y)) break;
             }
-            if (isDeadEnd(x, y)) {
+            if (isDeadEnd(x, y) && carved < cells) {
                 do {
                     x = 2 * (rand() % ((width - 1) / 2)) + 1;
                     y = 2 * (rand() % ((height - 1) / 2)) + 1;
@@ -94,7 +302,10 @@ public:
         maze[height - 2][width - 2] = PASS;
     }
 
-    vector<pair<int, int>> findShortestPath(int startX, int startY, int endX, int endY) {
+    vector<pair<int, int>> findShortestPath(int startX, int startY, int endX, int endY, PathBackend backend = BFS) {
+        if (backend == ASTAR) return findPathAStar(startX, startY, endX, endY);
+        if (backend == JPS) return findPathJPS(startX, startY, endX, endY);
+
         vector<pair<int, int>> path;
         map<pair<int, int>, pair<int, int>> parent;
         queue<pair<int, int>> q;
@@ -127,121 +338,2507 @@ public:
         return path;
     }
 
-    void draw(sf::RenderWindow& window, sf::Sprite wallSprites[4], sf::RectangleShape& passRect,
-              int playerX, int playerY, bool fullView) const {
-        for (int i = 0; i < height; i++) {
-            for (int j = 0; j < width; j++) {
-                bool inView = fullView || (abs(i - playerY) <= VIEW_RADIUS && abs(j - playerX) <= VIEW_RADIUS);
-                if (inView) {
-                    if (maze[i][j] == WALL) {
-                        int textureIndex = (i + j) % 4;
-                        wallSprites[textureIndex].setPosition(j * TILE_SIZE, i * TILE_SIZE);
-                        window.draw(wallSprites[textureIndex]);
-                    } else {
-                        passRect.setPosition(j * TILE_SIZE, i * TILE_SIZE);
-                        window.draw(passRect);
+    vector<pair<int, int>> findPathAStar(int startX, int startY, int endX, int endY) const {
+        vector<pair<int, int>> path;
+        if (isWall(startX, startY) || isWall(endX, endY)) return path;
+
+        vector<int> g(width * height, INT_MAX), parent(width * height, -1);
+        priority_queue<tuple<int, int, int>, vector<tuple<int, int, int>>, greater<>> open;
+        int start = startY * width + startX, end = endY * width + endX;
+        g[start] = 0;
+        open.push({manhattan(startX, startY, endX, endY), 0, start});
+
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+
+        while (!open.empty()) {
+            auto [f, negG, cur] = open.top(); open.pop();
+            if (-negG != g[cur]) continue;
+            if (cur == end) break;
+            int x = cur % width, y = cur / width;
+            for (int i = 0; i < 4; ++i) {
+                int nx = x + dx[i], ny = y + dy[i];
+                if (isWall(nx, ny)) continue;
+                int next = ny * width + nx;
+                if (g[cur] + 1 < g[next]) {
+                    g[next] = g[cur] + 1;
+                    parent[next] = cur;
+                    // Ties on f go to the deeper node, which keeps A* from flooding open rooms.
+                    open.push({g[next] + manhattan(nx, ny, endX, endY), -g[next], next});
+                }
+            }
+        }
+        if (g[end] == INT_MAX) return path;
+        for (int cur = end; cur != -1; cur = parent[cur])
+            path.push_back({cur / width, cur % width});
+        reverse(path.begin(), path.end());
+        return path;
+    }
+
+    vector<pair<int, int>> findPathJPS(int startX, int startY, int endX, int endY) const {
+        vector<pair<int, int>> path;
+        if (isWall(startX, startY) || isWall(endX, endY)) return path;
+
+        vector<int> g(width * height, INT_MAX), parent(width * height, -1);
+        priority_queue<tuple<int, int, int>, vector<tuple<int, int, int>>, greater<>> open;
+        int start = startY * width + startX, end = endY * width + endX;
+        g[start] = 0;
+        open.push({manhattan(startX, startY, endX, endY), 0, start});
+
+        auto relax = [&](int from, int to) {
+            if (to == -1) return;
+            int fx = from % width, fy = from / width, tx = to % width, ty = to / width;
+            int cost = g[from] + abs(tx - fx) + abs(ty - fy);
+            if (cost < g[to]) {
+                g[to] = cost;
+                parent[to] = from;
+                open.push({cost + manhattan(tx, ty, endX, endY), -cost, to});
+            }
+        };
+
+        while (!open.empty()) {
+            auto [f, negG, cur] = open.top(); open.pop();
+            if (-negG != g[cur]) continue;
+            if (cur == end) break;
+            int x = cur % width, y = cur / width;
+            if (parent[cur] == -1) {
+                relax(cur, jumpHorizontal(x, y, -1, endX, endY));
+                relax(cur, jumpHorizontal(x, y, 1, endX, endY));
+                relax(cur, jumpVertical(x, y, -1, endX, endY));
+                relax(cur, jumpVertical(x, y, 1, endX, endY));
+                continue;
+            }
+            int px = parent[cur] % width, py = parent[cur] / width;
+            if (py == y) {
+                int dx = x > px ? 1 : -1;
+                relax(cur, jumpHorizontal(x, y, dx, endX, endY));
+                for (int dy = -1; dy <= 1; dy += 2)
+                    if (!isWall(x, y + dy) && isWall(x - dx, y + dy))
+                        relax(cur, jumpVertical(x, y, dy, endX, endY));
+            } else {
+                int dy = y > py ? 1 : -1;
+                relax(cur, jumpVertical(x, y, dy, endX, endY));
+                relax(cur, jumpHorizontal(x, y, -1, endX, endY));
+                relax(cur, jumpHorizontal(x, y, 1, endX, endY));
+            }
+        }
+        if (g[end] == INT_MAX) return path;
+
+        path.push_back({endY, endX});
+        for (int cur = end; parent[cur] != -1; cur = parent[cur]) {
+            int x = cur % width, y = cur / width;
+            int px = parent[cur] % width, py = parent[cur] / width;
+            while (x != px || y != py) {
+                x += (px > x) - (px < x);
+                y += (py > y) - (py < y);
+                path.push_back({y, x});
+            }
+        }
+        reverse(path.begin(), path.end());
+        return path;
+    }
+
+    void scatterTerrain() {
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+        int patches = width * height / 150;
+        for (int p = 0; p < patches; ++p) {
+            Terrain type = static_cast<Terrain>(p % 3 == 0 ? ROAD : p % 3 == 1 ? MUD : WATER);
+            int x = rand() % width, y = rand() % height;
+            if (maze[y][x] != PASS) continue;
+            for (int step = 0; step < 12; ++step) {
+                terrain[y * width + x] = type;
+                int i = rand() % 4;
+                if (!isWall(x + dx[i], y + dy[i])) {
+                    x += dx[i];
+                    y += dy[i];
+                }
+            }
+        }
+    }
+
+    // Dial's algorithm: one bucket per distance modulo the largest step cost, so every
+    // push and pop is O(1) and the search stays close to plain BFS.
+    vector<pair<int, int>> findCheapestPath(int startX, int startY, int endX, int endY) const {
+        vector<pair<int, int>> path;
+        if (isWall(startX, startY) || isWall(endX, endY)) return path;
+
+        vector<int> dist(width * height, INT_MAX), parent(width * height, -1);
+        vector<int> buckets[MAX_TERRAIN_COST + 1];
+        int start = startY * width + startX, end = endY * width + endX;
+        dist[start] = 0;
+        buckets[0].push_back(start);
+        int pending = 1;
+
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+
+        for (int d = 0; pending > 0 && dist[end] > d; ++d) {
+            vector<int>& bucket = buckets[d % (MAX_TERRAIN_COST + 1)];
+            for (size_t k = 0; k < bucket.size(); ++k) {
+                int cur = bucket[k];
+                if (dist[cur] != d) continue;
+                int x = cur % width, y = cur / width;
+                for (int i = 0; i < 4; ++i) {
+                    int nx = x + dx[i], ny = y + dy[i];
+                    if (isWall(nx, ny)) continue;
+                    int next = ny * width + nx;
+                    int cost = d + getCost(nx, ny);
+                    if (cost < dist[next]) {
+                        dist[next] = cost;
+                        parent[next] = cur;
+                        buckets[cost % (MAX_TERRAIN_COST + 1)].push_back(next);
+                        pending++;
                     }
                 }
             }
+            pending -= bucket.size();
+            bucket.clear();
         }
+        if (dist[end] == INT_MAX) return path;
+        for (int cur = end; cur != -1; cur = parent[cur])
+            path.push_back({cur / width, cur % width});
+        reverse(path.begin(), path.end());
+        return path;
     }
-};
 
-class Unit {
-protected:
-    int x, y;
-    bool isMoving;
+    vector<int> distanceField(int x, int y) const {
+        vector<int> dist, q;
+        distanceField(x, y, dist, q);
+        return dist;
+    }
 
-public:
-    int getX() const { return x; }
-    int getY() const { return y; }
-    void setX(int val) { x = val; }
-    void setY(int val) { y = val; }
-    Unit(int startX = 0, int startY = 0) : x(startX), y(startY), isMoving(false) {}
+    void distanceField(int x, int y, vector<int>& dist, vector<int>& q) const {
+        dist.assign(width * height, -1);
+        q.clear();
+        if (isWall(x, y)) return;
+        q.reserve(width * height);
+        q.push_back(y * width + x);
+        dist[q[0]] = 0;
+        int offsets[] = {-width, width, -1, 1};
+        for (size_t head = 0; head < q.size(); ++head) {
+            int cur = q[head];
+            for (int offset : offsets) {
+                int next = cur + offset;
+                if (next < 0 || next >= width * height || dist[next] != -1) continue;
+                if (isWall(next % width, next / width) || abs(next % width - cur % width) > 1) continue;
+                dist[next] = dist[cur] + 1;
+                q.push_back(next);
+            }
+        }
+    }
 
-    virtual void move(int dx, int dy, const Maze& maze) {
-        int newX = x + dx;
-        int newY = y + dy;
-        if (!maze.isWall(newX, newY)) {
-            x = newX;
-            y = newY;
-            isMoving = true;
-        } else {
-            isMoving = false;
+    vector<pair<int, int>> scatterCoins(int count, int startX, int startY) {
+        vector<pair<int, int>> coins;
+        for (int attempts = 0; (int)coins.size() < count && attempts < count * 100; ++attempts) {
+            int x = 2 * (rand() % ((width - 1) / 2)) + 1, y = 2 * (rand() % ((height - 1) / 2)) + 1;
+            if ((x == startX && y == startY) || (x == width - 2 && y == height - 2)) continue;
+            if (maze[y][x] != PASS || items[y * width + x] != NO_ITEM) continue;
+            items[y * width + x] = COIN_ITEM;
+            coins.push_back({x, y});
         }
+        return coins;
     }
 
-    virtual void update() = 0;
-    virtual void draw(sf::RenderWindow& window) = 0;
-};
+    // BFS over (cell, key set). Visited cells are a bitset per key set, allocated the first
+    // time that key set is reached; parents are packed into a nibble per state (direction
+    // plus whether the step picked up the key that is lying there).
+    vector<pair<int, int>> findPathWithKeys(int startX, int startY, int startKeys, int endX, int endY) const {
+        vector<pair<int, int>> path;
+        if (!isPassable(startX, startY, startKeys) || isWall(endX, endY)) return path;
 
+        const int masks = 1 << MAX_KEYS;
+        vector<BitGrid> visited(masks);
+        vector<vector<uint8_t>> parents(masks);
+        auto reach = [&](int mask, int cell, int link) {
+            if (visited[mask].getWidth() == 0) {
+                visited[mask] = BitGrid(width, height);
+                parents[mask].assign((width * height + 1) / 2, 0);
+            }
+            if (visited[mask].test(cell)) return false;
+            visited[mask].set(cell);
+            parents[mask][cell >> 1] |= link << ((cell & 1) * 4);
+            return true;
+        };
+
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+        vector<uint64_t> q;
+        int start = startY * width + startX, end = endY * width + endX;
+        int startMask = startKeys | keyAt(startX, startY);
+        reach(startMask, start, 0);
+        q.push_back(static_cast<uint64_t>(startMask) << 32 | static_cast<uint32_t>(start));
+        int endMask = -1;
+        for (size_t head = 0; head < q.size() && endMask == -1; ++head) {
+            int cur = static_cast<uint32_t>(q[head]), mask = q[head] >> 32;
+            int x = cur % width, y = cur / width;
+            for (int i = 0; i < 4; ++i) {
+                int nx = x + dx[i], ny = y + dy[i];
+                int next = ny * width + nx;
+                if (maze[ny][nx] == WALL) continue;
+                int item = items[next];
+                if ((item & ~ITEM_COLOR_MASK) == LOCK_ITEM && !(mask >> (item & ITEM_COLOR_MASK) & 1)) continue;
+                int nextMask = (item & ~ITEM_COLOR_MASK) == KEY_ITEM ? mask | 1 << (item & ITEM_COLOR_MASK) : mask;
+                if (!reach(nextMask, next, i | (nextMask != mask) << 2)) continue;
+                if (next == end) {
+                    endMask = nextMask;
+                    break;
+                }
+                q.push_back(static_cast<uint64_t>(nextMask) << 32 | static_cast<uint32_t>(next));
+            }
+        }
+        if (start == end) endMask = startMask;
+        if (endMask == -1) return path;
+
+        for (int cur = end, mask = endMask; ; ) {
+            path.push_back({cur / width, cur % width});
+            if (cur == start && mask == startMask) break;
+            int link = parents[mask][cur >> 1] >> ((cur & 1) * 4) & 0xF;
+            if (link & 4) mask &= ~keyAt(cur % width, cur / width);
+            cur -= dy[link & 3] * width + dx[link & 3];
+        }
+        reverse(path.begin(), path.end());
+        return path;
+    }
+
+    bool placeKeysAndDoors(int startX, int startY, int keyCount) {
+        int exitX = width - 2, exitY = height - 2;
+        vector<int> toExit = distanceField(exitX, exitY);
+        if (toExit[startY * width + startX] < 0) return false;
+
+        vector<int> route;
+        for (int cur = startY * width + startX; cur != exitY * width + exitX; ) {
+            route.push_back(cur);
+            int offsets[] = {-width, width, -1, 1};
+            for (int offset : offsets) {
+                if (toExit[cur + offset] == toExit[cur] - 1) {
+                    cur += offset;
+                    break;
+                }
+            }
+        }
+        vector<char> onRoute(width * height, 0);
+        for (int cell : route) onRoute[cell] = 1;
+
+        keyCount = min(keyCount, MAX_KEYS);
+        for (int k = 0; k < keyCount; ++k) {
+            size_t at = route.size() * (k + 1) / (keyCount + 1);
+            while (at + 1 < route.size() && (route[at] % width + route[at] / width) % 2 == 0) at++;
+            items[route[at]] = LOCK_ITEM | k;
+        }
+
+        // Key k goes in the stretch that lock k-1 opens up, so keys are found in order and the
+        // solver only ever sees keyCount + 1 distinct key sets.
+        vector<char> earlier(width * height, 0);
+        for (int k = 0; k < keyCount; ++k) {
+            vector<int> candidates, reachable = reachableWithKeys(startX, startY, (1 << k) - 1);
+            for (int cell : reachable) {
+                int x = cell % width, y = cell / width;
+                if (items[cell] == NO_ITEM && !onRoute[cell] && !earlier[cell] && x % 2 == 1 && y % 2 == 1 &&
+                    countOpenNeighbors(x, y) == 1)
+                    candidates.push_back(cell);
+            }
+            for (int cell : reachable) earlier[cell] = 1;
+            if (candidates.empty()) {
+                for (int cell : reachable)
+                    if (items[cell] == NO_ITEM && cell != startY * width + startX) candidates.push_back(cell);
+            }
+            if (candidates.empty()) break;
+            items[candidates[rand() % candidates.size()]] = KEY_ITEM | k;
+        }
+
+        if (findPathWithKeys(startX, startY, 0, exitX, exitY).empty()) {
+            fill(items.begin(), items.end(), NO_ITEM);
+            return false;
+        }
+        return true;
+    }
+
+    void braid(int percent) {
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+        for (int y = 1; y < height - 1; y += 2) {
+            for (int x = 1; x < width - 1; x += 2) {
+                if (maze[y][x] != PASS || countOpenNeighbors(x, y) != 1 || rand() % 100 >= percent) continue;
+                int options[4], n = 0;
+                for (int i = 0; i < 4; ++i) {
+                    int nx = x + 2 * dx[i], ny = y + 2 * dy[i];
+                    if (nx > 0 && ny > 0 && nx < width - 1 && ny < height - 1 &&
+                        maze[y + dy[i]][x + dx[i]] == WALL && maze[ny][nx] == PASS)
+                        options[n++] = i;
+                }
+                if (n > 0) {
+                    int i = options[rand() % n];
+                    maze[y + dy[i]][x + dx[i]] = PASS;
+                }
+            }
+        }
+    }
+
+    void carveRooms(int count, int maxSize) {
+        for (int r = 0; r < count; ++r) {
+            int w = 2 * (rand() % (maxSize / 2) + 1) + 1;
+            int h = 2 * (rand() % (maxSize / 2) + 1) + 1;
+            if (w > width - 2 || h > height - 2) continue;
+            int x0 = 2 * (rand() % ((width - w) / 2)) + 1;
+            int y0 = 2 * (rand() % ((height - h) / 2)) + 1;
+            for (int y = y0; y < y0 + h; ++y)
+                for (int x = x0; x < x0 + w; ++x)
+                    maze[y][x] = PASS;
+        }
+    }
 
-class Player : public Unit {
 private:
-    vector<sf::Texture> animationFrames;
-    sf::Sprite sprite;
-    int currentFrame;
-    sf::Clock animationClock;
-    float frameTime;
+    static int manhattan(int x1, int y1, int x2, int y2) {
+        return abs(x1 - x2) + abs(y1 - y2);
+    }
+
+    vector<int> reachableWithKeys(int x, int y, int keys) const {
+        vector<int> cells;
+        vector<char> seen(width * height, 0);
+        cells.push_back(y * width + x);
+        seen[cells[0]] = 1;
+        int offsets[] = {-width, width, -1, 1};
+        for (size_t head = 0; head < cells.size(); ++head) {
+            for (int offset : offsets) {
+                int next = cells[head] + offset;
+                if (seen[next] || !isPassable(next % width, next / width, keys)) continue;
+                seen[next] = 1;
+                cells.push_back(next);
+            }
+        }
+        return cells;
+    }
+
+    int countOpenNeighbors(int x, int y) const {
+        return !isWall(x - 1, y) + !isWall(x + 1, y) + !isWall(x, y - 1) + !isWall(x, y + 1);
+    }
+
+    // 4-connected jump point search: horizontal scans stop at forced vertical openings,
+    // vertical scans stop wherever a horizontal scan from the current cell finds a jump point.
+    int jumpHorizontal(int x, int y, int dx, int endX, int endY) const {
+        while (true) {
+            x += dx;
+            if (isWall(x, y)) return -1;
+            if (x == endX && y == endY) return y * width + x;
+            if ((!isWall(x, y - 1) && isWall(x - dx, y - 1)) || (!isWall(x, y + 1) && isWall(x - dx, y + 1)))
+                return y * width + x;
+        }
+    }
+
+    int jumpVertical(int x, int y, int dy, int endX, int endY) const {
+        while (true) {
+            y += dy;
+            if (isWall(x, y)) return -1;
+            if (x == endX && y == endY) return y * width + x;
+            if (jumpHorizontal(x, y, -1, endX, endY) != -1 || jumpHorizontal(x, y, 1, endX, endY) != -1)
+                return y * width + x;
+        }
+    }
+};
+
+// D* Lite searches backwards from the goal, so a moving start only bumps km and a wall
+// toggle only re-expands the cells whose distance to the goal actually changed.
+class DStarLite : public MazeListener {
+private:
+    static constexpr int INF = INT_MAX / 4;
+
+    Maze& maze;
+    int width, height;
+    int start, goal, lastStart;
+    int km;
+    bool dirty;
+    vector<int> g, rhs;
+    vector<pair<int, int>> openKey;
+    vector<char> inOpen;
+    priority_queue<tuple<int, int, int>, vector<tuple<int, int, int>>, greater<>> open;
+    vector<pair<int, int>> path;
 
 public:
-    bool movementKeyPressed;
+    DStarLite(Maze& maze, int startX, int startY, int goalX, int goalY)
+        : maze(maze), width(maze.getWidth()), height(maze.getHeight()),
+          start(startY * width + startX), goal(goalY * width + goalX), lastStart(start), km(0), dirty(true),
+          g(width * height, INF), rhs(width * height, INF), openKey(width * height), inOpen(width * height, 0) {
+        rhs[goal] = 0;
+        push(goal);
+        maze.subscribe(this);
+    }
 
-    Player(int startX = 1, int startY = 1)
-        : Unit(startX, startY), currentFrame(0), frameTime(0.45f),
-          movementKeyPressed(false) {
-        loadAnimationFrames({
-            "Tiles/slime1.png",
-            "Tiles/slime2.png",
-            "Tiles/slime3.png",
-            "Tiles/slime4.png",
-            "Tiles/slime5.png",
-            "Tiles/slime6.png"
-        });
-    }
-
-    void loadAnimationFrames(const vector<string>& texturePaths) {
-        for (const auto& path : texturePaths) {
-            sf::Texture texture;
-            if (!texture.loadFromFile(path)) {
-                cerr << "Error loading texture: " << path << endl;
-                exit(1);
+    ~DStarLite() override {
+        maze.unsubscribe(this);
+    }
+
+    DStarLite(const DStarLite&) = delete;
+    DStarLite& operator=(const DStarLite&) = delete;
+
+    void setStart(int x, int y) {
+        int next = y * width + x;
+        if (next == start) return;
+        start = next;
+        km += heuristic(lastStart, start);
+        lastStart = start;
+        dirty = true;
+    }
+
+    void onCellChanged(int x, int y) override {
+        int cell = y * width + x;
+        updateVertex(cell);
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+        for (int i = 0; i < 4; ++i) {
+            int nx = x + dx[i], ny = y + dy[i];
+            if (nx >= 0 && ny >= 0 && nx < width && ny < height)
+                updateVertex(ny * width + nx);
+        }
+        dirty = true;
+    }
+
+    const vector<pair<int, int>>& getPath() {
+        if (!dirty) return path;
+        computeShortestPath();
+        dirty = false;
+        path.clear();
+        if (g[start] >= INF) return path;
+
+        for (int cur = start, steps = 0; steps <= width * height; ++steps) {
+            path.push_back({cur / width, cur % width});
+            if (cur == goal) break;
+            cur = bestStep(cur);
+            if (cur == -1) {
+                path.clear();
+                break;
             }
-            animationFrames.push_back(texture);
         }
-        if (!animationFrames.empty()) {
-            sprite.setTexture(animationFrames[0]);
-            sprite.setScale(
-                TILE_SIZE / static_cast<float>(animationFrames[0].getSize().x),
-                TILE_SIZE / static_cast<float>(animationFrames[0].getSize().y)
-            );
+        return path;
+    }
+
+    // Only the first step of the path, for agents that replan every move; the start itself when
+    // the goal is cut off or already reached.
+    pair<int, int> nextStep() {
+        computeShortestPath();
+        int next = start != goal && g[start] < INF ? bestStep(start) : -1;
+        if (next == -1) next = start;
+        return {next / width, next % width};
+    }
+
+private:
+    int bestStep(int cur) const {
+        int x = cur % width, y = cur / width, best = -1, bestCost = INF;
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+        for (int i = 0; i < 4; ++i) {
+            int nx = x + dx[i], ny = y + dy[i];
+            if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+            int next = ny * width + nx;
+            int c = min(INF, cost(cur, next) + g[next]);
+            if (c < bestCost) {
+                bestCost = c;
+                best = next;
+            }
         }
+        return best;
     }
 
-    void update() override {
-        if (isMoving && animationClock.getElapsedTime().asSeconds() >= frameTime) {
-            currentFrame = (currentFrame + 1) % animationFrames.size();
-            sprite.setTexture(animationFrames[currentFrame]);
-            animationClock.restart();
+    int heuristic(int a, int b) const {
+        return (abs(a % width - b % width) + abs(a / width - b / width)) * TERRAIN_COST[ROAD];
+    }
+
+    int cost(int from, int to) const {
+        if (maze.isWall(from % width, from / width) || maze.isWall(to % width, to / width)) return INF;
+        return maze.getCost(to % width, to / width);
+    }
+
+    pair<int, int> calculateKey(int s) const {
+        int m = min(g[s], rhs[s]);
+        if (m >= INF) return {INF, INF};
+        return {m + heuristic(start, s) + km, m};
+    }
+
+    void push(int s) {
+        openKey[s] = calculateKey(s);
+        inOpen[s] = 1;
+        open.push({openKey[s].first, openKey[s].second, s});
+    }
+
+    void updateVertex(int u) {
+        if (u != goal) {
+            rhs[u] = INF;
+            int x = u % width, y = u / width;
+            int dx[] = {0, 0, -1, 1};
+            int dy[] = {-1, 1, 0, 0};
+            for (int i = 0; i < 4; ++i) {
+                int nx = x + dx[i], ny = y + dy[i];
+                if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+                int next = ny * width + nx;
+                rhs[u] = min(rhs[u], min(INF, cost(u, next) + g[next]));
+            }
+        }
+        if (g[u] != rhs[u]) push(u);
+        else inOpen[u] = 0;
+    }
+
+    void updateNeighbors(int u) {
+        int x = u % width, y = u / width;
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+        for (int i = 0; i < 4; ++i) {
+            int nx = x + dx[i], ny = y + dy[i];
+            if (nx >= 0 && ny >= 0 && nx < width && ny < height)
+                updateVertex(ny * width + nx);
         }
-        if (!isMoving) {
-            currentFrame = 0;
-            sprite.setTexture(animationFrames[0]);
+    }
+
+    void computeShortestPath() {
+        while (!open.empty()) {
+            auto [k1, k2, u] = open.top();
+            pair<int, int> key = {k1, k2};
+            if (!inOpen[u] || openKey[u] != key) {
+                open.pop();
+                continue;
+            }
+            if (!(key < calculateKey(start)) && rhs[start] == g[start]) break;
+            open.pop();
+            pair<int, int> newKey = calculateKey(u);
+            if (key < newKey) {
+                push(u);
+            } else if (g[u] > rhs[u]) {
+                g[u] = rhs[u];
+                inOpen[u] = 0;
+                updateNeighbors(u);
+            } else {
+                g[u] = INF;
+                updateVertex(u);
+                updateNeighbors(u);
+            }
         }
-        isMoving = false;
+    }
+};
+
+// For every cell and direction: where a run in that direction stops (the next junction, dead
+// end or item) and how long it is. Chains between stops are walked once from each end, so the
+// first build is linear in the maze size. After that a changed cell only re-walks the chains
+// through it and its neighbours, which are the only cells whose stop status can change.
+class CorridorTable : public MazeListener {
+private:
+    Maze& maze;
+    int width, height;
+    bool dirty;
+    vector<int> runEnd;
+    vector<int> runInfo;
+    vector<int> chain, chainDirs;
+    vector<int> walked;
+    int epoch = 0;
+    vector<int> around, seeds;
+
+public:
+    static const int DX[4];
+    static const int DY[4];
+
+    explicit CorridorTable(Maze& maze)
+        : maze(maze), width(maze.getWidth()), height(maze.getHeight()), dirty(true) {
+        maze.subscribe(this);
+    }
+
+    ~CorridorTable() override {
+        maze.unsubscribe(this);
+    }
+
+    CorridorTable(const CorridorTable&) = delete;
+    CorridorTable& operator=(const CorridorTable&) = delete;
+
+    void onCellChanged(int x, int y) override {
+        if (!dirty) rewalkAround(y * width + x);
+    }
+
+    // Returns the cell the run ends on, the number of steps and the direction of the last step,
+    // or an end of -1 when the first step is blocked.
+    tuple<int, int, int> run(int x, int y, int dir) {
+        if (dirty) rebuild();
+        int slot = (y * width + x) * 4 + dir;
+        return {runEnd[slot], runInfo[slot] >> 2, runInfo[slot] & 3};
+    }
+
+    // The cells a run steps through, as (y, x) pairs like the path finders return.
+    vector<pair<int, int>> runPath(int x, int y, int dir) {
+        auto [end, length, arrive] = run(x, y, dir);
+        vector<pair<int, int>> steps;
+        if (end < 0) return steps;
+        for (int cur = y * width + x, k = 0; k < length; ++k) {
+            cur += DY[dir] * width + DX[dir];
+            steps.push_back({cur / width, cur % width});
+            dir = otherExit(cur, opposite(dir));
+        }
+        return steps;
+    }
+
+private:
+    bool open(int cell) const {
+        return !maze.isWall(cell % width, cell / width);
+    }
+
+    bool isStop(int cell) const {
+        int x = cell % width, y = cell / width, exits = 0;
+        for (int d = 0; d < 4; ++d) exits += !maze.isWall(x + DX[d], y + DY[d]);
+        return exits != 2 || maze.getItem(x, y) != NO_ITEM || (x == width - 2 && y == height - 2);
+    }
+
+    int otherExit(int cell, int cameFrom) const {
+        for (int d = 0; d < 4; ++d)
+            if (d != cameFrom && !maze.isWall(cell % width + DX[d], cell / width + DY[d])) return d;
+        return cameFrom;
+    }
+
+    static int opposite(int dir) { return dir ^ 1; }
+
+    bool openToward(int cell, int dir) const {
+        return !maze.isWall(cell % width + DX[dir], cell / width + DY[dir]);
+    }
+
+    void rebuild() {
+        dirty = false;
+        runEnd.assign(width * height * 4, -1);
+        runInfo.assign(width * height * 4, 0);
+        walked.assign(width * height, 0);
+
+        for (int cell = 0; cell < width * height; ++cell)
+            if (open(cell) && isStop(cell)) walkFrom(cell);
+
+        // Whatever is left are loops with no junction at all. Cells with no open neighbour are
+        // stops, so every cell that gets here has two exits.
+        for (int cell = 0; cell < width * height; ++cell) {
+            if (!open(cell) || otherExit(cell, -1) == -1 || runEnd[cell * 4 + otherExit(cell, -1)] != -1) continue;
+            walkLoop(cell);
+        }
+    }
+
+    // The old entries of the cells around a change still name the far ends of every chain that
+    // passes through them. Walking out of those ends and out of any new stop rewrites all of the
+    // affected chains; a cell left unvisited has become part of a loop with no stop at all.
+    void rewalkAround(int changed) {
+        int x = changed % width, y = changed / width;
+        around.assign(1, changed);
+        for (int d = 0; d < 4; ++d)
+            if (x + DX[d] >= 0 && y + DY[d] >= 0 && x + DX[d] < width && y + DY[d] < height)
+                around.push_back(changed + DY[d] * width + DX[d]);
+        seeds.clear();
+        for (int cell : around) {
+            seeds.push_back(cell);
+            for (int d = 0; d < 4; ++d) {
+                int slot = cell * 4 + d;
+                if (runEnd[slot] >= 0) seeds.push_back(runEnd[slot]);
+                if (!open(cell) || !openToward(cell, d)) {
+                    runEnd[slot] = -1;
+                    runInfo[slot] = 0;
+                }
+            }
+        }
+        sort(seeds.begin(), seeds.end());
+        seeds.erase(unique(seeds.begin(), seeds.end()), seeds.end());
+
+        epoch++;
+        for (int cell : seeds)
+            if (open(cell) && isStop(cell)) walkFrom(cell);
+        for (int cell : around)
+            if (open(cell) && !isStop(cell) && walked[cell] != epoch) walkLoop(cell);
+    }
+
+    void walkFrom(int stop) {
+        for (int d = 0; d < 4; ++d)
+            if (openToward(stop, d)) walkChain(stop, d);
+    }
+
+    // A run anywhere on a loop without stops goes once around and ends where it started.
+    void walkLoop(int cell) {
+        walkChain(cell, otherExit(cell, -1));
+        int length = chain.size() + 1;
+        chain.push_back(cell);
+        for (int member : chain) {
+            walked[member] = epoch;
+            int first = otherExit(member, -1), second = otherExit(member, first);
+            runEnd[member * 4 + first] = runEnd[member * 4 + second] = member;
+            runInfo[member * 4 + first] = length << 2 | opposite(second);
+            runInfo[member * 4 + second] = length << 2 | opposite(first);
+        }
+    }
+
+    void walkChain(int from, int dir) {
+        chain.clear();
+        chainDirs.clear();
+        int cur = from + DY[dir] * width + DX[dir], arrive = dir;
+        chainDirs.push_back(dir);
+        while (cur != from && !isStop(cur)) {
+            chain.push_back(cur);
+            walked[cur] = epoch;
+            arrive = otherExit(cur, opposite(arrive));
+            chainDirs.push_back(arrive);
+            cur += DY[arrive] * width + DX[arrive];
+        }
+        int length = chain.size() + 1;
+        runEnd[from * 4 + dir] = cur;
+        runInfo[from * 4 + dir] = length << 2 | arrive;
+        for (int k = 0; k < (int)chain.size(); ++k) {
+            int slot = chain[k] * 4 + chainDirs[k + 1];
+            runEnd[slot] = cur;
+            runInfo[slot] = (length - k - 1) << 2 | arrive;
+        }
+    }
+};
+
+const int CorridorTable::DX[4] = {0, 0, -1, 1};
+const int CorridorTable::DY[4] = {-1, 1, 0, 0};
+
+class FieldOfView : public MazeListener {
+private:
+    Maze& maze;
+    int width, height;
+    int radius;
+    int originX = -1, originY = -1;
+    int version = 0;
+    bool dirty = true;
+    BitGrid visible;
+    vector<int> cells;
+
+public:
+    FieldOfView(Maze& maze, int radius)
+        : maze(maze), width(maze.getWidth()), height(maze.getHeight()), radius(radius),
+          visible(maze.getWidth(), maze.getHeight()) {
+        maze.subscribe(this);
+    }
+
+    ~FieldOfView() override {
+        maze.unsubscribe(this);
+    }
+
+    FieldOfView(const FieldOfView&) = delete;
+    FieldOfView& operator=(const FieldOfView&) = delete;
+
+    void onCellChanged(int x, int y) override {
+        if (abs(x - originX) <= radius && abs(y - originY) <= radius) dirty = true;
+    }
+
+    bool isVisible(int x, int y) const { return visible.test(x, y); }
+    const BitGrid& getVisible() const { return visible; }
+    const vector<int>& getCells() const { return cells; }
+    int getVersion() const { return version; }
+
+    void compute(int x, int y) {
+        if (!dirty && x == originX && y == originY) return;
+        dirty = false;
+        originX = x;
+        originY = y;
+        version++;
+        for (int cell : cells) visible.reset(cell);
+        cells.clear();
+        mark(x, y);
+        static const int mult[4][8] = {
+            {1, 0, 0, -1, -1, 0, 0, 1},
+            {0, 1, -1, 0, 0, -1, 1, 0},
+            {0, 1, 1, 0, 0, -1, -1, 0},
+            {1, 0, 0, 1, -1, 0, 0, -1}
+        };
+        for (int octant = 0; octant < 8; ++octant)
+            castLight(1, 1.0f, 0.0f, mult[0][octant], mult[1][octant], mult[2][octant], mult[3][octant]);
+    }
+
+private:
+    void mark(int x, int y) {
+        if (visible.test(x, y)) return;
+        visible.set(x, y);
+        cells.push_back(y * width + x);
+    }
+
+    bool blocks(int x, int y) const {
+        return x < 0 || y < 0 || x >= width || y >= height || maze.isWall(x, y);
+    }
+
+    void castLight(int row, float start, float end, int xx, int xy, int yx, int yy) {
+        if (start < end) return;
+        float newStart = 0.0f;
+        for (int depth = row; depth <= radius; ++depth) {
+            bool blocked = false;
+            for (int dx = -depth, dy = -depth; dx <= 0; ++dx) {
+                float leftSlope = (dx - 0.5f) / (dy + 0.5f), rightSlope = (dx + 0.5f) / (dy - 0.5f);
+                if (start < rightSlope) continue;
+                if (end > leftSlope) break;
+                int x = originX + dx * xx + dy * xy, y = originY + dx * yx + dy * yy;
+                bool wall = blocks(x, y);
+                if (x >= 0 && y >= 0 && x < width && y < height) mark(x, y);
+                if (blocked) {
+                    if (wall) {
+                        newStart = rightSlope;
+                    } else {
+                        blocked = false;
+                        start = newStart;
+                    }
+                } else if (wall && depth < radius) {
+                    blocked = true;
+                    castLight(depth + 1, start, leftSlope, xx, xy, yx, yy);
+                    newStart = rightSlope;
+                }
+            }
+            if (blocked) break;
+        }
+    }
+};
+
+// Explored cells keep their colour on the minimap, so a door that toggles inside explored ground
+// is repainted on the next reveal.
+class ExploredMap : public MazeListener {
+private:
+    Maze& maze;
+    int width, height;
+    int lastVersion = -1;
+    BitGrid explored;
+    sf::Texture texture;
+    vector<sf::Uint8> patch;
+    vector<int> changed;
+
+public:
+    explicit ExploredMap(Maze& maze)
+        : maze(maze), width(maze.getWidth()), height(maze.getHeight()), explored(maze.getWidth(), maze.getHeight()) {
+        texture.create(width, height);
+        vector<sf::Uint8> blank(static_cast<size_t>(width) * height * 4, 0);
+        texture.update(blank.data());
+        maze.subscribe(this);
+    }
+
+    ~ExploredMap() override {
+        maze.unsubscribe(this);
+    }
+
+    ExploredMap(const ExploredMap&) = delete;
+    ExploredMap& operator=(const ExploredMap&) = delete;
+
+    void onCellChanged(int x, int y) override {
+        if (explored.test(x, y)) changed.push_back(y * width + x);
+    }
+
+    bool isExplored(int x, int y) const { return explored.test(x, y); }
+    const BitGrid& getExplored() const { return explored; }
+    const sf::Texture& getTexture() const { return texture; }
+
+    void reveal(const FieldOfView& view) {
+        for (int cell : changed) paint(cell % width, cell / width, 1, 1);
+        changed.clear();
+        if (view.getVersion() == lastVersion) return;
+        lastVersion = view.getVersion();
+        int x0 = width, y0 = height, x1 = -1, y1 = -1;
+        for (int cell : view.getCells()) {
+            if (explored.test(cell)) continue;
+            explored.set(cell);
+            x0 = min(x0, cell % width);
+            x1 = max(x1, cell % width);
+            y0 = min(y0, cell / width);
+            y1 = max(y1, cell / width);
+        }
+        if (x1 >= 0) paint(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+    }
+
+private:
+    void paint(int x0, int y0, int w, int h) {
+        patch.resize(w * h * 4);
+        for (int y = y0; y < y0 + h; ++y) {
+            for (int x = x0; x < x0 + w; ++x) {
+                sf::Color color = sf::Color::Transparent;
+                if (explored.test(x, y))
+                    color = maze.isWall(x, y) ? sf::Color(90, 90, 90) : TERRAIN_COLOR[maze.getTerrain(x, y)];
+                sf::Uint8* texel = &patch[((y - y0) * w + x - x0) * 4];
+                texel[0] = color.r;
+                texel[1] = color.g;
+                texel[2] = color.b;
+                texel[3] = color.a;
+            }
+        }
+        texture.update(patch.data(), w, h, x0, y0);
+    }
+};
+
+// Four-bit wall neighbour masks for autotiling: bit d is set when the cell is a wall and so is its
+// neighbour in direction d (up, down, left, right). The grid is packed into rows of 64-bit words with
+// a wall border, and every mask comes out of shifted-row ANDs in a single pass.
+class WallMasks : public MazeListener {
+private:
+    Maze& maze;
+    int width, height, words, stride;
+    vector<uint8_t> masks;
+
+public:
+    explicit WallMasks(Maze& maze)
+        : maze(maze), width(maze.getWidth()), height(maze.getHeight()), words((maze.getWidth() + 63) / 64), stride(words * 64) {
+        compute();
+        maze.subscribe(this);
+    }
+
+    ~WallMasks() override {
+        maze.unsubscribe(this);
+    }
+
+    WallMasks(const WallMasks&) = delete;
+    WallMasks& operator=(const WallMasks&) = delete;
+
+    int at(int x, int y) const { return masks[static_cast<size_t>(y) * stride + x]; }
+
+    void onCellChanged(int x, int y) override {
+        refresh(x, y);
+        refresh(x, y - 1);
+        refresh(x, y + 1);
+        refresh(x - 1, y);
+        refresh(x + 1, y);
+    }
+
+    void compute() {
+        int padded = words + 2;
+        vector<uint64_t> rows(static_cast<size_t>(padded) * (height + 2), ~uint64_t(0));
+        for (int y = 0; y < height; ++y)
+            pack(maze.row(y), &rows[static_cast<size_t>(y + 1) * padded + 1]);
+
+        uint64_t spread[256];
+        for (int b = 0; b < 256; ++b) {
+            spread[b] = 0;
+            for (int k = 0; k < 8; ++k)
+                if (b >> k & 1) spread[b] |= uint64_t(1) << (8 * k);
+        }
+
+        masks.resize(static_cast<size_t>(stride) * height);
+        for (int y = 0; y < height; ++y) {
+            const uint64_t* up = &rows[static_cast<size_t>(y) * padded + 1];
+            const uint64_t* row = up + padded;
+            const uint64_t* down = row + padded;
+            uint8_t* out = &masks[static_cast<size_t>(y) * stride];
+            int i = 0;
+#if defined(__AVX2__)
+            for (; i + 4 <= words; i += 4) {
+                __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i));
+                __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i - 1));
+                __m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + i + 1));
+                alignas(32) uint64_t planes[4][4];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(planes[0]),
+                                   _mm256_and_si256(cur, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(up + i))));
+                _mm256_store_si256(reinterpret_cast<__m256i*>(planes[1]),
+                                   _mm256_and_si256(cur, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(down + i))));
+                _mm256_store_si256(reinterpret_cast<__m256i*>(planes[2]),
+                                   _mm256_and_si256(cur, _mm256_or_si256(_mm256_slli_epi64(cur, 1), _mm256_srli_epi64(left, 63))));
+                _mm256_store_si256(reinterpret_cast<__m256i*>(planes[3]),
+                                   _mm256_and_si256(cur, _mm256_or_si256(_mm256_srli_epi64(cur, 1), _mm256_slli_epi64(right, 63))));
+                for (int k = 0; k < 4; ++k)
+                    unpack(spread, planes[0][k], planes[1][k], planes[2][k], planes[3][k], out + (i + k) * 64);
+            }
+#elif defined(__SSE2__)
+            for (; i + 2 <= words; i += 2) {
+                __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i));
+                __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i - 1));
+                __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + i + 1));
+                alignas(16) uint64_t planes[4][2];
+                _mm_store_si128(reinterpret_cast<__m128i*>(planes[0]),
+                                _mm_and_si128(cur, _mm_loadu_si128(reinterpret_cast<const __m128i*>(up + i))));
+                _mm_store_si128(reinterpret_cast<__m128i*>(planes[1]),
+                                _mm_and_si128(cur, _mm_loadu_si128(reinterpret_cast<const __m128i*>(down + i))));
+                _mm_store_si128(reinterpret_cast<__m128i*>(planes[2]),
+                                _mm_and_si128(cur, _mm_or_si128(_mm_slli_epi64(cur, 1), _mm_srli_epi64(left, 63))));
+                _mm_store_si128(reinterpret_cast<__m128i*>(planes[3]),
+                                _mm_and_si128(cur, _mm_or_si128(_mm_srli_epi64(cur, 1), _mm_slli_epi64(right, 63))));
+                for (int k = 0; k < 2; ++k)
+                    unpack(spread, planes[0][k], planes[1][k], planes[2][k], planes[3][k], out + (i + k) * 64);
+            }
+#endif
+            for (; i < words; ++i) {
+                uint64_t cur = row[i];
+                unpack(spread, cur & up[i], cur & down[i], cur & (cur << 1 | row[i - 1] >> 63),
+                       cur & (cur >> 1 | row[i + 1] << 63), out + i * 64);
+            }
+        }
+    }
+
+private:
+    // Bit x of a row word is set for a wall; cells past the right edge count as wall, like Maze::get.
+    void pack(const int* cells, uint64_t* row) const {
+        fill(row, row + words, 0);
+        int x = 0;
+#if defined(__AVX2__)
+        __m256i walls8 = _mm256_set1_epi32(WALL);
+        for (; x + 8 <= width; x += 8) {
+            __m256i hit = _mm256_cmpeq_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(cells + x)), walls8);
+            row[x >> 6] |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(hit))) << (x & 63);
+        }
+#elif defined(__SSE2__)
+        __m128i walls4 = _mm_set1_epi32(WALL);
+        for (; x + 4 <= width; x += 4) {
+            __m128i hit = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(cells + x)), walls4);
+            row[x >> 6] |= uint64_t(_mm_movemask_ps(_mm_castsi128_ps(hit))) << (x & 63);
+        }
+#endif
+        for (; x < width; ++x)
+            row[x >> 6] |= uint64_t(cells[x] == WALL) << (x & 63);
+        if (width & 63) row[words - 1] |= ~uint64_t(0) << (width & 63);
+    }
+
+    // Turns 64 cells of the four direction planes into 64 mask bytes, eight cells per table lookup.
+    static void unpack(const uint64_t* spread, uint64_t up, uint64_t down, uint64_t left, uint64_t right, uint8_t* out) {
+        for (int b = 0; b < 64; b += 8) {
+            uint64_t bytes = spread[up >> b & 255] | spread[down >> b & 255] << 1 |
+                             spread[left >> b & 255] << 2 | spread[right >> b & 255] << 3;
+            memcpy(out + b, &bytes, sizeof(bytes));
+        }
+    }
+
+    void refresh(int x, int y) {
+        if (x < 0 || y < 0 || x >= width || y >= height) return;
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+        int mask = 0;
+        if (maze.isWall(x, y))
+            for (int d = 0; d < 4; ++d)
+                if (maze.isWall(x + dx[d], y + dy[d])) mask |= 1 << d;
+        masks[static_cast<size_t>(y) * stride + x] = mask;
+    }
+};
+
+// Wave function collapse over tile variants. Tiles 0..3 are wall variants and 4..7 floor variants;
+// every cell starts with the four of its kind as a bitset. The cell with the fewest options is
+// collapsed first (ties broken by seeded noise) and the choice is pushed through the adjacency rules
+// with an explicit stack: touching walls never repeat a texture and decorated floors never touch.
+// Doors are solved as walls and open onto a plain floor, which no rule can reject.
+class TileDecorator {
+private:
+    static const int TILES = 2 * TILE_VARIANTS;
+    static constexpr int WEIGHTS[TILES] = {1, 1, 1, 1, 6, 1, 1, 1};
+
+    const Maze& maze;
+    int width, height;
+    mt19937 rng;
+    vector<uint8_t> options;
+    uint8_t support[1 << TILES];
+    priority_queue<uint64_t, vector<uint64_t>, greater<uint64_t>> heap;
+    vector<int> stack;
+    int contradictions = 0;
+
+public:
+    TileDecorator(const Maze& maze, unsigned seed)
+        : maze(maze), width(maze.getWidth()), height(maze.getHeight()), rng(seed),
+          options(static_cast<size_t>(maze.getWidth()) * maze.getHeight()) {
+        uint8_t allowed[TILES];
+        for (int a = 0; a < TILES; ++a) {
+            allowed[a] = 0;
+            for (int b = 0; b < TILES; ++b) {
+                bool wallA = a < TILE_VARIANTS, wallB = b < TILE_VARIANTS;
+                bool ok = wallA != wallB || (wallA ? a != b : a == TILE_VARIANTS || b == TILE_VARIANTS);
+                if (ok) allowed[a] |= 1 << b;
+            }
+        }
+        for (int set = 0; set < (1 << TILES); ++set) {
+            support[set] = 0;
+            for (int t = 0; t < TILES; ++t)
+                if (set >> t & 1) support[set] |= allowed[t];
+        }
+    }
+
+    // Per cell, row by row, the variant as a wall plus TILE_VARIANTS times the variant as a floor.
+    vector<uint8_t> solve(const vector<pair<int, int>>& doors = {}) {
+        const uint8_t wallTiles = (1 << TILE_VARIANTS) - 1, floorTiles = wallTiles << TILE_VARIANTS;
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                options[y * width + x] = maze.isWall(x, y) ? wallTiles : floorTiles;
+        for (auto [x, y] : doors)
+            options[y * width + x] = wallTiles;
+        contradictions = 0;
+        heap = {};
+        for (int cell = 0; cell < width * height; ++cell)
+            push(cell);
+
+        while (!heap.empty()) {
+            uint64_t top = heap.top();
+            heap.pop();
+            int cell = static_cast<int>(top & 0xFFFFFFFF);
+            int count = __builtin_popcount(options[cell]);
+            if (count <= 1 || count != static_cast<int>(top >> 56)) continue;
+            options[cell] = 1 << pick(options[cell]);
+            propagate(cell);
+        }
+
+        vector<uint8_t> variants(options.size());
+        for (size_t i = 0; i < options.size(); ++i) {
+            int variant = __builtin_ctz(options[i]) % TILE_VARIANTS;
+            variants[i] = variant + TILE_VARIANTS * variant;
+        }
+        for (auto [x, y] : doors)
+            variants[y * width + x] %= TILE_VARIANTS;
+        return variants;
+    }
+
+    int getContradictions() const { return contradictions; }
+
+private:
+    void push(int cell) {
+        uint64_t noise = rng() & 0xFFFFFF;
+        heap.push(uint64_t(__builtin_popcount(options[cell])) << 56 | noise << 32 | static_cast<uint32_t>(cell));
+    }
+
+    int pick(uint8_t set) {
+        int total = 0;
+        for (int t = 0; t < TILES; ++t)
+            if (set >> t & 1) total += WEIGHTS[t];
+        int roll = static_cast<int>(rng() % total);
+        for (int t = 0; t < TILES; ++t) {
+            if (!(set >> t & 1)) continue;
+            roll -= WEIGHTS[t];
+            if (roll < 0) return t;
+        }
+        return __builtin_ctz(set);
+    }
+
+    // A neighbour that would be left with no options keeps its set; the clash is counted, not undone.
+    void propagate(int start) {
+        int dx[] = {0, 0, -1, 1};
+        int dy[] = {-1, 1, 0, 0};
+        stack.assign(1, start);
+        while (!stack.empty()) {
+            int cell = stack.back();
+            stack.pop_back();
+            uint8_t reach = support[options[cell]];
+            int x = cell % width, y = cell / width;
+            for (int d = 0; d < 4; ++d) {
+                int nx = x + dx[d], ny = y + dy[d];
+                if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+                int next = ny * width + nx;
+                uint8_t narrowed = options[next] & reach;
+                if (narrowed == options[next]) continue;
+                if (!narrowed) {
+                    contradictions++;
+                    continue;
+                }
+                options[next] = narrowed;
+                stack.push_back(next);
+                push(next);
+            }
+        }
+    }
+};
+
+class MazeMesh : public MazeListener {
+private:
+    struct Slot {
+        int chunk = -1;
+        vector<sf::Vertex> vertices;
+        list<int>::iterator age;
+    };
+
+    Maze& maze;
+    const sf::Texture& atlas;
+    const WallMasks& masks;
+    int width, height;
+    int chunksX, chunksY;
+    float atlasTile;
+    bool useBuffer;
+    vector<Slot> slots;
+    vector<int> slotOf;
+    vector<char> stale;
+    list<int> lru;
+    vector<sf::Vertex> scratch;
+
+    // The chunks in view, laid out back to back so the whole visible maze is one draw call.
+    sf::VertexBuffer visible{sf::Quads, sf::VertexBuffer::Stream};
+    vector<sf::Vertex> visibleVertices;
+    sf::IntRect visibleChunks;
+
+    sf::Texture fog, sight;
+    vector<sf::Uint8> patch, sightPatch;
+    int lastVersion = -1;
+    sf::IntRect lastView;
+
+public:
+    // Atlas columns are the 16 wall masks plus the floor; rows are tile variants.
+    static const int PASS_SLOT = 16;
+    static const int CHUNK_SIZE = 32;
+    static constexpr int MAX_RESIDENT_CHUNKS = 256;
+
+    MazeMesh(Maze& maze, const sf::Texture& atlas, const WallMasks& masks)
+        : maze(maze), atlas(atlas), masks(masks), width(maze.getWidth()), height(maze.getHeight()),
+          chunksX((maze.getWidth() + CHUNK_SIZE - 1) / CHUNK_SIZE), chunksY((maze.getHeight() + CHUNK_SIZE - 1) / CHUNK_SIZE),
+          atlasTile(atlas.getSize().y / TILE_VARIANTS), useBuffer(sf::VertexBuffer::isAvailable()),
+          slots(min(MAX_RESIDENT_CHUNKS, chunksX * chunksY)), slotOf(chunksX * chunksY, -1), stale(chunksX * chunksY, 0) {
+        for (size_t i = 0; i < slots.size(); ++i)
+            slots[i].age = lru.insert(lru.end(), i);
+
+        fog.create(width, height);
+        vector<sf::Uint8> black(static_cast<size_t>(width) * height * 4, 0);
+        for (size_t i = 3; i < black.size(); i += 4) black[i] = 255;
+        fog.update(black.data());
+        sight.create(width, height);
+        sight.update(vector<sf::Uint8>(black.size(), 0).data());
+        maze.subscribe(this);
+    }
+
+    ~MazeMesh() override {
+        maze.unsubscribe(this);
+    }
+
+    MazeMesh(const MazeMesh&) = delete;
+    MazeMesh& operator=(const MazeMesh&) = delete;
+
+    // A wall change also retiles its neighbours, which may sit in the next chunk.
+    void onCellChanged(int x, int y) override {
+        int dx[] = {0, 0, 0, -1, 1};
+        int dy[] = {0, -1, 1, 0, 0};
+        for (int d = 0; d < 5; ++d) {
+            int nx = x + dx[d], ny = y + dy[d];
+            if (nx >= 0 && ny >= 0 && nx < width && ny < height)
+                stale[(ny / CHUNK_SIZE) * chunksX + nx / CHUNK_SIZE] = 1;
+        }
+    }
+
+    void update(const FieldOfView& view, const BitGrid& explored) {
+        if (view.getVersion() == lastVersion) return;
+        lastVersion = view.getVersion();
+        int x0 = width, y0 = height, x1 = -1, y1 = -1;
+        for (int cell : view.getCells()) {
+            x0 = min(x0, cell % width);
+            x1 = max(x1, cell % width);
+            y0 = min(y0, cell / width);
+            y1 = max(y1, cell / width);
+        }
+        sf::IntRect current(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+        updateFog(lastView, view, explored);
+        updateFog(current, view, explored);
+        lastView = current;
+    }
+
+    void drawAll(sf::RenderTarget& target, sf::RenderStates states) {
+        states.texture = &atlas;
+        for (int chunk = 0; chunk < chunksX * chunksY; ++chunk) {
+            buildChunk(chunk, scratch);
+            target.draw(scratch.data(), scratch.size(), sf::Quads, states);
+        }
+    }
+
+    // Repaints single cells of a target drawAll filled before, blacking them out first.
+    void drawCells(sf::RenderTarget& target, const vector<int>& cells, sf::RenderStates states) {
+        scratch.clear();
+        for (int cell : cells) {
+            float left = cell % width * TILE_SIZE, top = cell / width * TILE_SIZE;
+            scratch.emplace_back(sf::Vector2f(left, top), sf::Color::Black);
+            scratch.emplace_back(sf::Vector2f(left + TILE_SIZE, top), sf::Color::Black);
+            scratch.emplace_back(sf::Vector2f(left + TILE_SIZE, top + TILE_SIZE), sf::Color::Black);
+            scratch.emplace_back(sf::Vector2f(left, top + TILE_SIZE), sf::Color::Black);
+        }
+        target.draw(scratch.data(), scratch.size(), sf::Quads, states);
+        scratch.clear();
+        for (int cell : cells) appendCell(cell % width, cell / width, scratch);
+        states.texture = &atlas;
+        target.draw(scratch.data(), scratch.size(), sf::Quads, states);
+    }
+
+    // Only a change of the chunks in view re-uploads the whole window; an edited chunk in view
+    // rewrites just its own range.
+    void draw(CountingTexture& target, const sf::IntRect& cells) {
+        if (cells.width <= 0 || cells.height <= 0) return;
+        int cx0 = cells.left / CHUNK_SIZE, cx1 = (cells.left + cells.width - 1) / CHUNK_SIZE;
+        int cy0 = cells.top / CHUNK_SIZE, cy1 = (cells.top + cells.height - 1) / CHUNK_SIZE;
+        sf::IntRect chunks(cx0, cy0, cx1 - cx0 + 1, cy1 - cy0 + 1);
+        bool relayout = chunks != visibleChunks;
+        if (relayout) visibleVertices.clear();
+        size_t offset = 0;
+        for (int cy = cy0; cy <= cy1; ++cy) {
+            for (int cx = cx0; cx <= cx1; ++cx) {
+                bool rebuilt;
+                const vector<sf::Vertex>& vertices = slots[acquire(cy * chunksX + cx, rebuilt)].vertices;
+                if (relayout) {
+                    visibleVertices.insert(visibleVertices.end(), vertices.begin(), vertices.end());
+                } else if (rebuilt) {
+                    copy(vertices.begin(), vertices.end(), visibleVertices.begin() + offset);
+                    if (useBuffer) visible.update(vertices.data(), vertices.size(), offset);
+                }
+                offset += vertices.size();
+            }
+        }
+        if (relayout) {
+            visibleChunks = chunks;
+            if (useBuffer) {
+                if (visible.getVertexCount() < visibleVertices.size()) visible.create(visibleVertices.size());
+                visible.update(visibleVertices.data(), visibleVertices.size(), 0);
+            }
+        }
+        if (useBuffer) target.draw(visible, 0, visibleVertices.size(), &atlas);
+        else target.draw(visibleVertices.data(), visibleVertices.size(), sf::Quads, &atlas);
+        drawFog(target);
+    }
+
+    const sf::Texture& getFog() const { return fog; }
+    const sf::Texture& getSight() const { return sight; }
+
+    void drawFog(CountingTexture& target) const {
+        sf::Sprite overlay(fog);
+        overlay.setScale(TILE_SIZE, TILE_SIZE);
+        target.draw(overlay);
+    }
+
+private:
+    int acquire(int chunk, bool& rebuilt) {
+        rebuilt = false;
+        int index = slotOf[chunk];
+        if (index < 0) {
+            index = lru.back();
+            if (slots[index].chunk >= 0) slotOf[slots[index].chunk] = -1;
+            slots[index].chunk = chunk;
+            slotOf[chunk] = index;
+            stale[chunk] = 1;
+        }
+        Slot& slot = slots[index];
+        lru.splice(lru.begin(), lru, slot.age);
+        if (stale[chunk]) {
+            stale[chunk] = 0;
+            rebuilt = true;
+            buildChunk(chunk, slot.vertices);
+        }
+        return index;
+    }
+
+    void buildChunk(int chunk, vector<sf::Vertex>& out) const {
+        out.clear();
+        int x0 = (chunk % chunksX) * CHUNK_SIZE, y0 = (chunk / chunksX) * CHUNK_SIZE;
+        for (int y = y0; y < min(height, y0 + CHUNK_SIZE); ++y)
+            for (int x = x0; x < min(width, x0 + CHUNK_SIZE); ++x)
+                appendCell(x, y, out);
+    }
+
+    void appendCell(int x, int y, vector<sf::Vertex>& out) const {
+        bool wall = maze.isWall(x, y);
+        sf::Color color = wall ? sf::Color::White : TERRAIN_COLOR[maze.getTerrain(x, y)];
+        float left = x * TILE_SIZE, top = y * TILE_SIZE;
+        float u = (wall ? masks.at(x, y) : PASS_SLOT) * atlasTile, v = maze.getVariant(x, y) * atlasTile;
+        out.emplace_back(sf::Vector2f(left, top), color, sf::Vector2f(u, v));
+        out.emplace_back(sf::Vector2f(left + TILE_SIZE, top), color, sf::Vector2f(u + atlasTile, v));
+        out.emplace_back(sf::Vector2f(left + TILE_SIZE, top + TILE_SIZE), color, sf::Vector2f(u + atlasTile, v + atlasTile));
+        out.emplace_back(sf::Vector2f(left, top + TILE_SIZE), color, sf::Vector2f(u, v + atlasTile));
+    }
+
+    void updateFog(const sf::IntRect& rect, const FieldOfView& view, const BitGrid& explored) {
+        if (rect.width <= 0 || rect.height <= 0) return;
+        patch.resize(rect.width * rect.height * 4);
+        sightPatch.resize(patch.size());
+        for (int y = 0; y < rect.height; ++y) {
+            for (int x = 0; x < rect.width; ++x) {
+                int cx = rect.left + x, cy = rect.top + y;
+                bool visible = view.isVisible(cx, cy);
+                sf::Uint8* texel = &patch[(y * rect.width + x) * 4];
+                texel[0] = texel[1] = texel[2] = 0;
+                texel[3] = visible ? 0 : explored.test(cx, cy) ? 150 : 255;
+                texel = &sightPatch[(y * rect.width + x) * 4];
+                texel[0] = texel[1] = texel[2] = 255;
+                texel[3] = visible ? 255 : 0;
+            }
+        }
+        fog.update(patch.data(), rect.width, rect.height, rect.left, rect.top);
+        sight.update(sightPatch.data(), rect.width, rect.height, rect.left, rect.top);
+    }
+};
+
+class PathOverlay {
+private:
+    sf::Color color;
+    vector<pair<int, int>> cells;
+    vector<sf::Vertex> vertices;
+    vector<sf::IntRect> blocks;
+
+public:
+    static const int BLOCK_SIZE = 128;
+
+    explicit PathOverlay(sf::Color color) : color(color) {}
+
+    // Cells are stored goal first, so a path that only lost cells at its start keeps its vertices.
+    void set(const vector<pair<int, int>>& path) {
+        size_t shared = 0;
+        while (shared < cells.size() && shared < path.size() && cells[shared] == path[path.size() - 1 - shared])
+            shared++;
+        if (shared == cells.size() && shared == path.size()) return;
+
+        cells.resize(shared);
+        vertices.resize(shared * 4);
+        for (size_t i = shared; i < path.size(); ++i) {
+            auto [y, x] = path[path.size() - 1 - i];
+            cells.push_back({y, x});
+            float left = x * TILE_SIZE, top = y * TILE_SIZE;
+            sf::Vector2f texel(x + 0.5f, y + 0.5f);
+            vertices.emplace_back(sf::Vector2f(left, top), color, texel);
+            vertices.emplace_back(sf::Vector2f(left + TILE_SIZE, top), color, texel);
+            vertices.emplace_back(sf::Vector2f(left + TILE_SIZE, top + TILE_SIZE), color, texel);
+            vertices.emplace_back(sf::Vector2f(left, top + TILE_SIZE), color, texel);
+        }
+
+        blocks.resize((cells.size() + BLOCK_SIZE - 1) / BLOCK_SIZE);
+        for (size_t block = shared / BLOCK_SIZE; block < blocks.size(); ++block) {
+            int x0 = INT_MAX, y0 = INT_MAX, x1 = INT_MIN, y1 = INT_MIN;
+            for (size_t i = block * BLOCK_SIZE; i < min(cells.size(), (block + 1) * BLOCK_SIZE); ++i) {
+                x0 = min(x0, cells[i].second);
+                x1 = max(x1, cells[i].second);
+                y0 = min(y0, cells[i].first);
+                y1 = max(y1, cells[i].first);
+            }
+            blocks[block] = sf::IntRect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+        }
+    }
+
+    void draw(CountingTexture& target, const sf::IntRect& view, const sf::Texture* mask) const {
+        sf::IntRect overlap;
+        for (size_t block = 0; block < blocks.size();) {
+            if (!blocks[block].intersects(view, overlap)) {
+                block++;
+                continue;
+            }
+            size_t end = block + 1;
+            while (end < blocks.size() && blocks[end].intersects(view, overlap)) end++;
+            size_t first = block * BLOCK_SIZE * 4, last = min(vertices.size(), end * BLOCK_SIZE * 4);
+            target.draw(&vertices[first], last - first, sf::Quads, mask);
+            block = end;
+        }
+    }
+};
+
+class MazePyramid : public MazeListener {
+private:
+    struct Level {
+        int width, height;
+        int pagesX, pagesY;
+        vector<sf::Uint8> pixels;
+        vector<sf::Texture> pages;
+    };
+
+    Maze& maze;
+    vector<Level> levels;
+    vector<sf::Uint8> scratch;
+
+public:
+    static constexpr int PAGE_SIZE = 1024;
+
+    explicit MazePyramid(Maze& maze) : maze(maze) {
+        int w = maze.getWidth(), h = maze.getHeight();
+        levels.push_back(makeLevel(w, h));
+        for (int y = 0; y < h; ++y)
+            for (int x = 0; x < w; ++x)
+                writeCell(x, y);
+        while (w > 64 || h > 64) {
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+            levels.push_back(makeLevel(w, h));
+            for (int y = 0; y < h; ++y)
+                for (int x = 0; x < w; ++x)
+                    filter(levels.size() - 1, x, y);
+        }
+        for (size_t level = 0; level < levels.size(); ++level)
+            upload(level);
+        maze.subscribe(this);
+    }
+
+    ~MazePyramid() override {
+        maze.unsubscribe(this);
+    }
+
+    MazePyramid(const MazePyramid&) = delete;
+    MazePyramid& operator=(const MazePyramid&) = delete;
+
+    void onCellChanged(int x, int y) override {
+        writeCell(x, y);
+        uploadTexel(0, x, y);
+        for (size_t level = 1; level < levels.size(); ++level) {
+            x /= 2;
+            y /= 2;
+            filter(level, x, y);
+            uploadTexel(level, x, y);
+        }
+    }
+
+    void draw(CountingTexture& target, float cellPixels) const {
+        size_t level = 0;
+        while (level + 1 < levels.size() && cellPixels * (1 << (level + 1)) <= 1.0f) level++;
+        const Level& lod = levels[level];
+        const float cellsPerTexel = float(1 << level);
+        sf::IntRect cells = visibleCellRect(target.getView(), maze.getWidth(), maze.getHeight());
+        int px0 = cells.left / (1 << level) / PAGE_SIZE, px1 = (cells.left + cells.width) / (1 << level) / PAGE_SIZE;
+        int py0 = cells.top / (1 << level) / PAGE_SIZE, py1 = (cells.top + cells.height) / (1 << level) / PAGE_SIZE;
+        for (int py = py0; py <= min(py1, lod.pagesY - 1); ++py) {
+            for (int px = px0; px <= min(px1, lod.pagesX - 1); ++px) {
+                sf::Sprite page(lod.pages[py * lod.pagesX + px]);
+                page.setPosition(px * PAGE_SIZE * cellsPerTexel * TILE_SIZE, py * PAGE_SIZE * cellsPerTexel * TILE_SIZE);
+                page.setScale(cellsPerTexel * TILE_SIZE, cellsPerTexel * TILE_SIZE);
+                target.draw(page);
+            }
+        }
+    }
+
+private:
+    static Level makeLevel(int w, int h) {
+        Level level;
+        level.width = w;
+        level.height = h;
+        level.pagesX = (w + PAGE_SIZE - 1) / PAGE_SIZE;
+        level.pagesY = (h + PAGE_SIZE - 1) / PAGE_SIZE;
+        level.pixels.assign(static_cast<size_t>(w) * h * 4, 255);
+        level.pages.resize(level.pagesX * level.pagesY);
+        return level;
+    }
+
+    void writeCell(int x, int y) {
+        sf::Color color = maze.isWall(x, y) ? sf::Color(70, 90, 60) : TERRAIN_COLOR[maze.getTerrain(x, y)];
+        sf::Uint8* texel = &levels[0].pixels[(static_cast<size_t>(y) * levels[0].width + x) * 4];
+        texel[0] = color.r;
+        texel[1] = color.g;
+        texel[2] = color.b;
+    }
+
+    void filter(size_t level, int x, int y) {
+        const Level& child = levels[level - 1];
+        Level& parent = levels[level];
+        int sum[3] = {0, 0, 0}, count = 0;
+        for (int cy = 2 * y; cy < min(2 * y + 2, child.height); ++cy) {
+            for (int cx = 2 * x; cx < min(2 * x + 2, child.width); ++cx) {
+                const sf::Uint8* texel = &child.pixels[(static_cast<size_t>(cy) * child.width + cx) * 4];
+                for (int c = 0; c < 3; ++c) sum[c] += texel[c];
+                count++;
+            }
+        }
+        sf::Uint8* texel = &parent.pixels[(static_cast<size_t>(y) * parent.width + x) * 4];
+        for (int c = 0; c < 3; ++c) texel[c] = sum[c] / count;
+    }
+
+    void upload(size_t level) {
+        Level& lod = levels[level];
+        for (int py = 0; py < lod.pagesY; ++py) {
+            for (int px = 0; px < lod.pagesX; ++px) {
+                int x0 = px * PAGE_SIZE, y0 = py * PAGE_SIZE;
+                int w = min(PAGE_SIZE, lod.width - x0), h = min(PAGE_SIZE, lod.height - y0);
+                scratch.resize(static_cast<size_t>(w) * h * 4);
+                for (int y = 0; y < h; ++y)
+                    copy_n(&lod.pixels[((static_cast<size_t>(y0) + y) * lod.width + x0) * 4], w * 4, &scratch[static_cast<size_t>(y) * w * 4]);
+                sf::Texture& page = lod.pages[py * lod.pagesX + px];
+                page.create(w, h);
+                page.update(scratch.data());
+                page.setSmooth(true);
+            }
+        }
+    }
+
+    void uploadTexel(size_t level, int x, int y) {
+        Level& lod = levels[level];
+        sf::Texture& page = lod.pages[(y / PAGE_SIZE) * lod.pagesX + x / PAGE_SIZE];
+        page.update(&lod.pixels[(static_cast<size_t>(y) * lod.width + x) * 4], 1, 1, x % PAGE_SIZE, y % PAGE_SIZE);
+    }
+};
+
+class ShaderTilemap : public MazeListener {
+private:
+    Maze& maze;
+    const sf::Texture& atlas;
+    const WallMasks& masks;
+    int width, height, columns;
+    vector<sf::Uint8> codes;
+    sf::Texture cells;
+    sf::Shader shader;
+    bool ready = false;
+
+    static constexpr const char* VERTEX_SOURCE = R"(
+        varying vec2 world;
+        void main() {
+            world = gl_Vertex.xy;
+            gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+        }
+    )";
+
+    static constexpr const char* FRAGMENT_SOURCE = R"(
+        uniform sampler2D cells;
+        uniform sampler2D atlas;
+        uniform sampler2D fog;
+        uniform vec2 gridSize;
+        uniform vec2 cellsSize;
+        uniform float tileSize;
+        uniform vec2 atlasGrid;
+        uniform vec4 terrain[4];
+        varying vec2 world;
+
+        void main() {
+            vec2 cell = floor(world / tileSize);
+            if (cell.x < 0.0 || cell.y < 0.0 || cell.x >= gridSize.x || cell.y >= gridSize.y) discard;
+            vec4 packed = texture2D(cells, (vec2(floor(cell.x / 4.0), cell.y) + 0.5) / cellsSize);
+            float lane = mod(cell.x, 4.0);
+            float value = lane < 0.5 ? packed.r : lane < 1.5 ? packed.g : lane < 2.5 ? packed.b : packed.a;
+            float code = floor(value * 255.0 + 0.5);
+            bool wall = code >= 128.0;
+            float variant = wall ? floor((code - 128.0) / 16.0) : floor(code / 4.0);
+            vec2 slot = vec2(wall ? mod(code, 16.0) : atlasGrid.x - 1.0, variant);
+            vec4 color = texture2D(atlas, (slot + fract(world / tileSize)) / atlasGrid);
+            if (!wall) color *= terrain[int(mod(code, 4.0))];
+            float shade = texture2D(fog, (cell + 0.5) / gridSize).a;
+            gl_FragColor = vec4(color.rgb * (1.0 - shade), 1.0);
+        }
+    )";
+
+public:
+    ShaderTilemap(Maze& maze, const sf::Texture& atlas, const WallMasks& masks)
+        : maze(maze), atlas(atlas), masks(masks), width(maze.getWidth()), height(maze.getHeight()), columns((maze.getWidth() + 3) / 4),
+          codes(static_cast<size_t>(columns) * 4 * height, 0) {
+        if (!sf::Shader::isAvailable() || !shader.loadFromMemory(VERTEX_SOURCE, FRAGMENT_SOURCE)) return;
+        if (!cells.create(columns, height)) return;
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < width; ++x)
+                codes[static_cast<size_t>(y) * columns * 4 + x] = encode(x, y);
+        cells.update(codes.data());
+
+        sf::Glsl::Vec4 terrain[4];
+        for (int i = 0; i < 4; ++i) terrain[i] = sf::Glsl::Vec4(TERRAIN_COLOR[i]);
+        shader.setUniform("cells", cells);
+        shader.setUniform("atlas", atlas);
+        shader.setUniform("gridSize", sf::Glsl::Vec2(width, height));
+        shader.setUniform("cellsSize", sf::Glsl::Vec2(columns, height));
+        shader.setUniform("tileSize", float(TILE_SIZE));
+        shader.setUniform("atlasGrid", sf::Glsl::Vec2(MazeMesh::PASS_SLOT + 1, TILE_VARIANTS));
+        shader.setUniformArray("terrain", terrain, 4);
+        ready = true;
+        maze.subscribe(this);
+    }
+
+    ~ShaderTilemap() override {
+        if (ready) maze.unsubscribe(this);
+    }
+
+    ShaderTilemap(const ShaderTilemap&) = delete;
+    ShaderTilemap& operator=(const ShaderTilemap&) = delete;
+
+    bool isReady() const { return ready; }
+
+    // Relies on WallMasks having subscribed first, so the neighbour masks are already current.
+    void onCellChanged(int x, int y) override {
+        int dx[] = {0, 0, 0, -1, 1};
+        int dy[] = {0, -1, 1, 0, 0};
+        for (int d = 0; d < 5; ++d) {
+            int nx = x + dx[d], ny = y + dy[d];
+            if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+            size_t index = static_cast<size_t>(ny) * columns * 4 + nx;
+            codes[index] = encode(nx, ny);
+            cells.update(&codes[index - nx % 4], 1, 1, nx / 4, ny);
+        }
+    }
+
+    void draw(CountingTexture& target, const sf::Texture& fog) {
+        shader.setUniform("fog", fog);
+        const sf::View& camera = target.getView();
+        sf::RectangleShape screen(camera.getSize());
+        screen.setPosition(camera.getCenter() - camera.getSize() / 2.f);
+        target.draw(screen, &shader);
+    }
+
+private:
+    sf::Uint8 encode(int x, int y) const {
+        // Walls: 1vvmmmm (variant, mask). Floors: 0000vvtt (variant, terrain).
+        int variant = maze.getVariant(x, y);
+        return maze.isWall(x, y) ? 128 | variant << 4 | masks.at(x, y) : variant << 2 | maze.getTerrain(x, y);
+    }
+};
+
+// Optimal coin route: one BFS field per coin plus one for the exit, then a Held-Karp table
+// best[S][i] = cheapest walk from coin i through every coin in S to the exit. The table does
+// not depend on where the player is, so a hint or a pickup only costs O(K) lookups.
+class CoinRoute {
+private:
+    const Maze& maze;
+    int width, count;
+    vector<pair<int, int>> coins;
+    vector<vector<int>> fields;
+    vector<int> distances;
+    vector<int> best;
+
+public:
+    CoinRoute(const Maze& maze, const vector<pair<int, int>>& coins, int exitX, int exitY)
+        : maze(maze), width(maze.getWidth()), count(coins.size()), coins(coins), fields(coins.size() + 1) {
+        computeFields(exitX, exitY);
+        computeTable();
+    }
+
+    int coinAt(int x, int y) const {
+        for (int i = 0; i < count; ++i)
+            if (coins[i].first == x && coins[i].second == y) return i;
+        return -1;
+    }
+
+    int allCoins() const { return (1 << count) - 1; }
+
+    vector<pair<int, int>> hint(int x, int y, int remaining) const {
+        vector<pair<int, int>> path;
+        int cell = y * width + x;
+        int at = -1;
+        while (true) {
+            int next = at == -1 ? bestFirst(cell, remaining) : bestNext(at, remaining);
+            if (next == -1) break;
+            cell = walk(cell, fields[next], path);
+            if (cell == -1) return {};
+            remaining &= ~(1 << next);
+            at = next;
+        }
+        cell = walk(cell, fields[count], path);
+        if (cell == -1) return {};
+        path.push_back({cell / width, cell % width});
+        return path;
+    }
+
+private:
+    void computeFields(int exitX, int exitY) {
+        vector<pair<int, int>> sources = coins;
+        sources.push_back({exitX, exitY});
+        atomic<int> nextSource(0);
+        auto worker = [&]() {
+            vector<int> queue;
+            for (int i = nextSource++; i < (int)sources.size(); i = nextSource++)
+                maze.distanceField(sources[i].first, sources[i].second, fields[i], queue);
+        };
+        int threads = max(1, min((int)thread::hardware_concurrency(), (int)sources.size()));
+        vector<thread> pool;
+        for (int t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (thread& t : pool) t.join();
+    }
+
+    int dist(int from, int to) const {
+        return distances[from * (count + 1) + to];
+    }
+
+    void computeTable() {
+        const int INF = INT_MAX / 4;
+        distances.resize(count * (count + 1));
+        for (int i = 0; i < count; ++i) {
+            for (int j = 0; j <= count; ++j) {
+                int d = fields[j][coins[i].second * width + coins[i].first];
+                distances[i * (count + 1) + j] = d < 0 ? INF : d;
+            }
+        }
+
+        best.assign((1 << count) * max(count, 1), INF);
+        for (int i = 0; i < count; ++i)
+            best[i] = dist(i, count);
+        vector<int> rest(count);
+        for (int set = 1; set < (1 << count); ++set) {
+            for (int bits = set; bits; bits &= bits - 1) {
+                int j = __builtin_ctz(bits);
+                rest[j] = best[(set ^ 1 << j) * count + j];
+            }
+            for (int i = 0; i < count; ++i) {
+                if (set >> i & 1) continue;
+                const int* row = &distances[i * (count + 1)];
+                int value = INF;
+                for (int bits = set; bits; bits &= bits - 1) {
+                    int j = __builtin_ctz(bits);
+                    value = min(value, row[j] + rest[j]);
+                }
+                best[set * count + i] = min(value, INF);
+            }
+        }
+    }
+
+    int bestFirst(int cell, int remaining) const {
+        int choice = -1, cost = INT_MAX;
+        for (int i = 0; i < count; ++i) {
+            if (!(remaining >> i & 1) || fields[i][cell] < 0 || best[(remaining ^ 1 << i) * count + i] >= INT_MAX / 4) continue;
+            int total = fields[i][cell] + best[(remaining ^ 1 << i) * count + i];
+            if (total < cost) {
+                cost = total;
+                choice = i;
+            }
+        }
+        return choice;
+    }
+
+    int bestNext(int at, int remaining) const {
+        int choice = -1, cost = INT_MAX;
+        for (int j = 0; j < count; ++j) {
+            if (!(remaining >> j & 1) || dist(at, j) >= INT_MAX / 4) continue;
+            int total = dist(at, j) + best[(remaining ^ 1 << j) * count + j];
+            if (total < cost) {
+                cost = total;
+                choice = j;
+            }
+        }
+        return choice;
+    }
+
+    int walk(int cell, const vector<int>& field, vector<pair<int, int>>& path) const {
+        if (field[cell] < 0) return -1;
+        int offsets[] = {-width, width, -1, 1};
+        while (field[cell] > 0) {
+            path.push_back({cell / width, cell % width});
+            for (int offset : offsets) {
+                if (field[cell + offset] == field[cell] - 1) {
+                    cell += offset;
+                    break;
+                }
+            }
+        }
+        return cell;
+    }
+};
+
+class SpriteBatch {
+private:
+    struct Layer {
+        const sf::Texture* texture;
+        vector<sf::Vertex> vertices;
+    };
+
+    vector<Layer> layers;
+    size_t lastLayer = 0;
+    const sf::Texture* atlas = nullptr;
+    float frameSize = 0;
+
+public:
+    void setAtlas(const sf::Texture& texture) {
+        atlas = &texture;
+        frameSize = texture.getSize().y;
+    }
+
+    void clear() {
+        for (Layer& layer : layers) layer.vertices.clear();
+    }
+
+    void submit(const sf::Texture* texture, const sf::FloatRect& frame, const sf::FloatRect& bounds,
+                sf::Color color = sf::Color::White) {
+        if (lastLayer >= layers.size() || layers[lastLayer].texture != texture) {
+            lastLayer = 0;
+            while (lastLayer < layers.size() && layers[lastLayer].texture != texture) lastLayer++;
+            if (lastLayer == layers.size()) layers.push_back({texture, {}});
+        }
+        vector<sf::Vertex>& out = layers[lastLayer].vertices;
+        float right = bounds.left + bounds.width, bottom = bounds.top + bounds.height;
+        float u1 = frame.left + frame.width, v1 = frame.top + frame.height;
+        out.emplace_back(sf::Vector2f(bounds.left, bounds.top), color, sf::Vector2f(frame.left, frame.top));
+        out.emplace_back(sf::Vector2f(right, bounds.top), color, sf::Vector2f(u1, frame.top));
+        out.emplace_back(sf::Vector2f(right, bottom), color, sf::Vector2f(u1, v1));
+        out.emplace_back(sf::Vector2f(bounds.left, bottom), color, sf::Vector2f(frame.left, v1));
+    }
+
+    void submit(int slot, const sf::FloatRect& bounds, sf::Color color = sf::Color::White) {
+        submit(atlas, sf::FloatRect(slot * frameSize, 0, frameSize, frameSize), bounds, color);
+    }
+
+    size_t getSpriteCount() const {
+        size_t count = 0;
+        for (const Layer& layer : layers) count += layer.vertices.size() / 4;
+        return count;
+    }
+
+    void draw(CountingTexture& target) const {
+        for (const Layer& layer : layers)
+            if (!layer.vertices.empty())
+                target.draw(layer.vertices.data(), layer.vertices.size(), sf::Quads, layer.texture);
+    }
+};
+
+class Unit {
+protected:
+    int x, y;
+    int steps;
+    int keys;
+    bool isMoving;
+    float stepDelay;
+    deque<pair<int, int>> plannedPath;
+
+public:
+    int getX() const { return x; }
+    int getY() const { return y; }
+    void setX(int val) { x = val; }
+    void setY(int val) { y = val; }
+    int getSteps() const { return steps; }
+    int getKeys() const { return keys; }
+    float getStepDelay() const { return stepDelay; }
+    Unit(int startX = 0, int startY = 0)
+        : x(startX), y(startY), steps(0), keys(0), isMoving(false), stepDelay(TERRAIN_COST[FLOOR] * MOVE_DELAY_PER_COST) {}
+
+    virtual void move(int dx, int dy, const Maze& maze) {
+        int newX = x + dx;
+        int newY = y + dy;
+        if (maze.isPassable(newX, newY, keys)) {
+            x = newX;
+            y = newY;
+            steps++;
+            keys |= maze.keyAt(newX, newY);
+            isMoving = true;
+            stepDelay = maze.getCost(newX, newY) * MOVE_DELAY_PER_COST;
+        } else {
+            isMoving = false;
+        }
+    }
+
+    const deque<pair<int, int>>& getPlannedPath() const { return plannedPath; }
+
+    void setPlannedPath(const vector<pair<int, int>>& steps) {
+        plannedPath.assign(steps.begin(), steps.end());
+    }
+
+    void followPlannedPath(const Maze& maze) {
+        if (plannedPath.empty()) return;
+        auto [nextY, nextX] = plannedPath.front();
+        plannedPath.pop_front();
+        if (nextX == x && nextY == y) isMoving = false;
+        else move(nextX - x, nextY - y, maze);
+    }
+
+    virtual void update() = 0;
+    virtual void draw(SpriteBatch& batch) const = 0;
+};
+
+
+class Player : public Unit {
+private:
+    int currentFrame;
+    sf::Clock animationClock;
+    float frameTime;
+
+public:
+    bool movementKeyPressed;
+
+    Player(int startX = 1, int startY = 1)
+        : Unit(startX, startY), currentFrame(0), frameTime(0.45f),
+          movementKeyPressed(false) {}
+
+    void update() override {
+        if (isMoving && animationClock.getElapsedTime().asSeconds() >= frameTime) {
+            currentFrame = (currentFrame + 1) % SLIME_FRAMES;
+            animationClock.restart();
+        }
+        if (!isMoving) currentFrame = 0;
+        isMoving = false;
+    }
+
+    int getFrame() const { return currentFrame; }
+
+    void draw(SpriteBatch& batch) const override {
+        batch.submit(currentFrame, sf::FloatRect(x * TILE_SIZE, y * TILE_SIZE, TILE_SIZE, TILE_SIZE));
+    }
+};
+class Runner : public Unit {
+private:
+    int id;
+
+public:
+    Runner(int id, int startX, int startY) : Unit(startX, startY), id(id) {}
+
+    int getId() const { return id; }
+
+    void update() override {
+        isMoving = false;
+    }
+
+    void draw(SpriteBatch& batch) const override {
+        batch.submit(CIRCLE_SLOT, sf::FloatRect(x * TILE_SIZE + 8, y * TILE_SIZE + 8, TILE_SIZE - 16, TILE_SIZE - 16),
+                     sf::Color(220, 60, 200));
+    }
+};
+
+// Space-time reservations for the next `window` steps. Each step is a slot in a ring and
+// holds a small open-addressing table of (cell -> agent); a slot is wiped lazily the first
+// time it is written for a new step, so nothing is ever cleared in bulk. Released entries
+// stay behind as tombstones that later reservations reuse, and a slot that fills up with
+// them is rehashed in place.
+class ReservationTable {
+private:
+    int window, capacity;
+    vector<int> cells;
+    vector<uint16_t> owners;
+    vector<int> slotTime;
+    vector<int> used;
+
+public:
+    ReservationTable(int window, int maxAgents) : window(window), capacity(16), slotTime(window, -1), used(window, 0) {
+        while (capacity < 4 * maxAgents) capacity *= 2;
+        cells.assign(window * capacity, -1);
+        owners.assign(window * capacity, 0);
+    }
+
+    int owner(int cell, int t) const {
+        int slot = t % window;
+        if (slotTime[slot] != t) return -1;
+        int i = find(slot, cell);
+        return cells[i] == cell && owners[i] ? owners[i] - 1 : -1;
+    }
+
+    void reserve(int cell, int t, int agent) {
+        int slot = t % window;
+        if (slotTime[slot] != t) {
+            fill(cells.begin() + slot * capacity, cells.begin() + (slot + 1) * capacity, -1);
+            slotTime[slot] = t;
+            used[slot] = 0;
+        }
+        int i = find(slot, cell);
+        if (cells[i] != cell) {
+            if (used[slot] >= capacity * 3 / 4) compact(slot);
+            i = freeEntry(slot, cell);
+            if (cells[i] == -1) used[slot]++;
+            cells[i] = cell;
+        }
+        owners[i] = agent + 1;
+    }
+
+    void release(int cell, int t, int agent) {
+        int slot = t % window;
+        if (slotTime[slot] != t) return;
+        int i = find(slot, cell);
+        if (cells[i] == cell && owners[i] == agent + 1)
+            owners[i] = 0;
+    }
+
+    // Live reservations from step `t` on.
+    int countFrom(int t) const {
+        int count = 0;
+        for (int slot = 0; slot < window; ++slot) {
+            if (slotTime[slot] < t) continue;
+            for (int i = slot * capacity; i < (slot + 1) * capacity; ++i)
+                if (cells[i] != -1 && owners[i]) count++;
+        }
+        return count;
+    }
+
+    bool canMove(int from, int to, int t, int agent) const {
+        int blocker = owner(to, t + 1);
+        if (blocker != -1 && blocker != agent) return false;
+        int swapper = owner(to, t);
+        return swapper == -1 || swapper == agent || owner(from, t + 1) != swapper;
+    }
+
+private:
+    int find(int slot, int cell) const {
+        int base = slot * capacity;
+        int i = (cell * 2654435761u) & (capacity - 1);
+        while (cells[base + i] != -1 && cells[base + i] != cell)
+            i = (i + 1) & (capacity - 1);
+        return base + i;
+    }
+
+    // First empty entry or tombstone on the probe sequence of a cell that is not in the slot.
+    int freeEntry(int slot, int cell) const {
+        int base = slot * capacity;
+        int i = (cell * 2654435761u) & (capacity - 1);
+        while (cells[base + i] != -1 && owners[base + i])
+            i = (i + 1) & (capacity - 1);
+        return base + i;
+    }
+
+    void compact(int slot) {
+        int base = slot * capacity;
+        vector<pair<int, uint16_t>> live;
+        for (int i = base; i < base + capacity; ++i)
+            if (cells[i] != -1 && owners[i]) live.push_back({cells[i], owners[i]});
+        assert(live.size() < static_cast<size_t>(capacity) / 2);
+        fill(cells.begin() + base, cells.begin() + base + capacity, -1);
+        used[slot] = live.size();
+        for (auto [cell, owner] : live) {
+            int i = find(slot, cell);
+            cells[i] = cell;
+            owners[i] = owner;
+        }
+    }
+};
+
+// Windowed hierarchical cooperative A*: every runner replans a short space-time window
+// against the reservations of the others, staggered so only a slice replans per step.
+// The true distance to the exit serves as the heuristic, computed once per maze.
+class CooperativePlanner {
+private:
+    static const int WINDOW = 16;
+    static const int REPLAN_INTERVAL = WINDOW / 2;
+    static const int MAX_NODES = 8192;
+    static const int CLOSED_CAPACITY = 1 << 15;
+
+    struct Node {
+        int cell, t, g, parent;
+    };
+
+    const Maze& maze;
+    int width, goal, now;
+    vector<int> distToGoal;
+    ReservationTable table;
+    vector<int> occupant;
+    vector<Runner*> waiting;
+    vector<Node> nodes;
+    vector<tuple<int, int, int>> open;
+    vector<uint64_t> closedKeys;
+    vector<uint32_t> closedStamps;
+    uint32_t stamp;
+
+public:
+    CooperativePlanner(const Maze& maze, int goalX, int goalY, int maxAgents)
+        : maze(maze), width(maze.getWidth()), goal(goalY * maze.getWidth() + goalX), now(0),
+          distToGoal(maze.distanceField(goalX, goalY)), table(WINDOW + 1, maxAgents + 1),
+          occupant(maze.getWidth() * maze.getHeight(), -1),
+          closedKeys(CLOSED_CAPACITY), closedStamps(CLOSED_CAPACITY, 0), stamp(0) {
+        nodes.reserve(MAX_NODES + 5);
+        open.reserve(MAX_NODES + 5);
+    }
+
+    void add(const Runner& runner) {
+        int cell = runner.getY() * width + runner.getX();
+        occupant[cell] = runner.getId();
+        table.reserve(cell, now, runner.getId());
+    }
+
+    void remove(const Runner& runner) {
+        int cell = runner.getY() * width + runner.getX();
+        if (occupant[cell] == runner.getId()) occupant[cell] = -1;
+        releasePlan(runner, now);
+    }
+
+    bool hasArrived(const Runner& runner) const {
+        return runner.getY() * width + runner.getX() == goal;
+    }
+
+    // Reservations that no runner's position or remaining plan accounts for; anything but 0
+    // means a dropped plan leaked.
+    int strayReservations(const vector<Runner>& runners) const {
+        int owned = 0;
+        for (const Runner& runner : runners) {
+            int t = now;
+            if (table.owner(runner.getY() * width + runner.getX(), t) == runner.getId()) owned++;
+            for (auto [y, x] : runner.getPlannedPath())
+                if (table.owner(y * width + x, ++t) == runner.getId()) owned++;
+        }
+        return table.countFrom(now) - owned;
+    }
+
+    void step(vector<Runner>& runners, int playerX, int playerY) {
+        int playerCell = playerY * width + playerX;
+        for (Runner& runner : runners) {
+            if (runner.getPlannedPath().empty() || (now + runner.getId()) % REPLAN_INTERVAL == 0) {
+                releasePlan(runner, now);
+                runner.setPlannedPath(plan(runner, playerCell));
+                reservePlan(runner);
+            }
+        }
+
+        ++now;
+        // Moves are applied in passes so a runner can follow another into the cell it leaves
+        // this step; whoever still faces an occupied cell once nobody moves is blocked.
+        waiting.clear();
+        for (Runner& runner : runners)
+            if (!runner.getPlannedPath().empty()) waiting.push_back(&runner);
+        for (bool moved = true; moved;) {
+            moved = false;
+            size_t kept = 0;
+            for (Runner* runner : waiting) {
+                auto [nextY, nextX] = runner->getPlannedPath().front();
+                int from = runner->getY() * width + runner->getX(), to = nextY * width + nextX;
+                if (to != from && (occupant[to] != -1 || to == playerCell)) {
+                    waiting[kept++] = runner;
+                    continue;
+                }
+                occupant[from] = -1;
+                runner->followPlannedPath(maze);
+                occupant[to] = runner->getId();
+                moved = true;
+            }
+            waiting.resize(kept);
+        }
+
+        // Something stepped in that the reservations did not foresee; wait and replan. The plan
+        // was reserved before the clock advanced, so it is released on that time base.
+        for (Runner* runner : waiting) {
+            releasePlan(*runner, now - 1);
+            runner->setPlannedPath({});
+            table.reserve(runner->getY() * width + runner->getX(), now, runner->getId());
+        }
+    }
+
+private:
+    // Releases a plan reserved with the runner's current cell at `start`.
+    void releasePlan(const Runner& runner, int start) {
+        table.release(runner.getY() * width + runner.getX(), start, runner.getId());
+        int t = start;
+        for (auto [y, x] : runner.getPlannedPath())
+            table.release(y * width + x, ++t, runner.getId());
+    }
+
+    void reservePlan(const Runner& runner) {
+        table.reserve(runner.getY() * width + runner.getX(), now, runner.getId());
+        int t = now;
+        for (auto [y, x] : runner.getPlannedPath())
+            table.reserve(y * width + x, ++t, runner.getId());
+    }
+
+    bool markClosed(int cell, int t) {
+        uint64_t key = static_cast<uint64_t>(cell) * (WINDOW + 1) + t;
+        size_t mask = closedKeys.size() - 1;
+        size_t i = (key * 0x9E3779B97F4A7C15ull) >> 40 & mask;
+        while (closedStamps[i] == stamp) {
+            if (closedKeys[i] == key) return false;
+            i = (i + 1) & mask;
+        }
+        closedStamps[i] = stamp;
+        closedKeys[i] = key;
+        return true;
+    }
+
+    vector<pair<int, int>> plan(const Runner& runner, int playerCell) {
+        int id = runner.getId();
+        int start = runner.getY() * width + runner.getX();
+        if (distToGoal[start] < 0) return {};
+
+        ++stamp;
+        nodes.clear();
+        open.clear();
+        nodes.push_back({start, 0, 0, -1});
+        markClosed(start, 0);
+        open.push_back({distToGoal[start], 0, 0});
+
+        int offsets[] = {0, -width, width, -1, 1};
+        int best = 0;
+        while (!open.empty() && (int)nodes.size() < MAX_NODES) {
+            pop_heap(open.begin(), open.end(), greater<>());
+            int index = get<2>(open.back());
+            open.pop_back();
+            Node node = nodes[index];
+            if (node.cell == goal || node.t == WINDOW) {
+                best = index;
+                break;
+            }
+            if (distToGoal[node.cell] < distToGoal[nodes[best].cell]) best = index;
+            for (int offset : offsets) {
+                int next = node.cell + offset;
+                if (maze.isWall(next % width, next / width) || distToGoal[next] < 0) continue;
+                if (node.t == 0 && next == playerCell) continue;
+                if (!table.canMove(node.cell, next, now + node.t, id)) continue;
+                if (!markClosed(next, node.t + 1)) continue;
+                nodes.push_back({next, node.t + 1, node.g + 1, index});
+                open.push_back({node.g + 1 + distToGoal[next], -(node.t + 1), (int)nodes.size() - 1});
+                push_heap(open.begin(), open.end(), greater<>());
+            }
+        }
+
+        vector<pair<int, int>> steps;
+        if (best == 0) {
+            if (table.canMove(start, start, now, id)) steps.push_back({start / width, start % width});
+            return steps;
+        }
+        for (int i = best; nodes[i].parent != -1; i = nodes[i].parent)
+            steps.push_back({nodes[i].cell / width, nodes[i].cell % width});
+        reverse(steps.begin(), steps.end());
+        return steps;
+    }
+};
+
+// Distance to the player for every cell, kept as field[v] == dist(v, player) - playerSteps.
+// Every earlier player position p_k stays in the field as a source aged by the steps taken
+// since, and the player can be no further than that from p_k, so an old source never beats
+// the current one. A move therefore only has to lower the cells that got closer.
+class ChaseField {
+private:
+    const Maze& maze;
+    int width, height;
+    int playerSteps;
+    vector<int> field;
+    vector<int> queue;
+
+public:
+    ChaseField(const Maze& maze, int playerX, int playerY, int steps)
+        : maze(maze), width(maze.getWidth()), height(maze.getHeight()), playerSteps(steps),
+          field(maze.getWidth() * maze.getHeight(), INT_MAX) {
+        queue.reserve(width * height);
+        lowerFrom(playerX, playerY);
+    }
+
+    void movePlayer(int x, int y, int steps) {
+        if (steps == playerSteps) return;
+        playerSteps = steps;
+        lowerFrom(x, y);
+    }
+
+    int distance(int x, int y) const {
+        int value = field[y * width + x];
+        return value == INT_MAX ? -1 : value + playerSteps;
+    }
+
+    pair<int, int> nextStep(int x, int y) const {
+        int cur = y * width + x, best = cur;
+        int offsets[] = {-width, width, -1, 1};
+        for (int offset : offsets) {
+            int next = cur + offset;
+            if (field[next] < field[best]) best = next;
+        }
+        return {best % width - x, best / width - y};
+    }
+
+private:
+    void lowerFrom(int x, int y) {
+        int source = y * width + x;
+        if (field[source] <= -playerSteps) return;
+        field[source] = -playerSteps;
+        queue.clear();
+        queue.push_back(source);
+        int offsets[] = {-width, width, -1, 1};
+        for (size_t head = 0; head < queue.size(); ++head) {
+            int cur = queue[head];
+            for (int offset : offsets) {
+                int next = cur + offset;
+                if (field[cur] + 1 >= field[next] || maze.isWall(next % width, next / width)) continue;
+                field[next] = field[cur] + 1;
+                queue.push_back(next);
+            }
+        }
+    }
+};
+
+class ExploreField {
+private:
+    enum Phase { SETTLED, RAISE, SEED, LOWER };
+
+    const Maze& maze;
+    int width, height;
+    int lastVersion = -1;
+    int openCells = 0, exploredCells = 0;
+    BitGrid explored;
+    vector<int> field;
+    Phase phase = SETTLED;
+    vector<int> raised;
+    size_t cursor = 0;
+    vector<vector<int>> buckets;
+    size_t bucket = 0, topBucket = 0;
+
+public:
+    explicit ExploreField(const Maze& maze)
+        : maze(maze), width(maze.getWidth()), height(maze.getHeight()),
+          explored(maze.getWidth(), maze.getHeight()), field(maze.getWidth() * maze.getHeight(), INT_MAX) {
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                if (maze.isWall(x, y)) continue;
+                field[y * width + x] = 0;
+                openCells++;
+            }
+        }
+    }
+
+    bool isExplored(int x, int y) const { return explored.test(x, y); }
+    bool isSettled() const { return phase == SETTLED; }
+    bool isDone(int x, int y) const { return phase == SETTLED && field[y * width + x] == INT_MAX; }
+    int getExploredCells() const { return exploredCells; }
+    int getOpenCells() const { return openCells; }
+
+    void reveal(const FieldOfView& view) {
+        if (phase != SETTLED || view.getVersion() == lastVersion) return;
+        lastVersion = view.getVersion();
+        raised.clear();
+        for (int cell : view.getCells()) {
+            if (explored.test(cell)) continue;
+            explored.set(cell);
+            if (maze.isWall(cell % width, cell / width)) continue;
+            exploredCells++;
+            field[cell] = INT_MAX;
+            raised.push_back(cell);
+        }
+        if (raised.empty()) return;
+        phase = RAISE;
+        cursor = 0;
+    }
+
+    void repair(int budget) {
+        int offsets[] = {-width, width, -1, 1};
+        while (phase == RAISE && budget > 0) {
+            if (cursor == raised.size()) {
+                phase = SEED;
+                cursor = 0;
+                bucket = SIZE_MAX;
+                topBucket = 0;
+                break;
+            }
+            int cur = raised[cursor++];
+            budget--;
+            for (int offset : offsets) {
+                int next = cur + offset;
+                if (field[next] == INT_MAX || field[next] == 0 || supported(next)) continue;
+                field[next] = INT_MAX;
+                raised.push_back(next);
+            }
+        }
+
+        while (phase == SEED && budget > 0) {
+            if (cursor == raised.size()) {
+                phase = bucket == SIZE_MAX ? SETTLED : LOWER;
+                break;
+            }
+            int cell = raised[cursor++];
+            budget--;
+            for (int offset : offsets) {
+                int next = cell + offset;
+                if (field[next] != INT_MAX && field[next] + 1 < field[cell]) field[cell] = field[next] + 1;
+            }
+            if (field[cell] == INT_MAX) continue;
+            if ((size_t)field[cell] >= buckets.size()) buckets.resize(field[cell] + 1);
+            bucket = min(bucket, (size_t)field[cell]);
+            topBucket = max(topBucket, (size_t)field[cell]);
+            buckets[field[cell]].push_back(cell);
+        }
+
+        while (phase == LOWER && budget > 0) {
+            if (bucket > topBucket) {
+                phase = SETTLED;
+                break;
+            }
+            if (buckets[bucket].empty()) {
+                bucket++;
+                budget--;
+                continue;
+            }
+            int cur = buckets[bucket].back();
+            buckets[bucket].pop_back();
+            budget--;
+            if (field[cur] != (int)bucket) continue;
+            for (int offset : offsets) {
+                int next = cur + offset;
+                if (field[cur] + 1 >= field[next] || maze.isWall(next % width, next / width)) continue;
+                field[next] = field[cur] + 1;
+                if (bucket + 1 == buckets.size()) buckets.emplace_back();
+                topBucket = max(topBucket, bucket + 1);
+                buckets[bucket + 1].push_back(next);
+            }
+        }
+    }
+
+    pair<int, int> nextStep(int x, int y) const {
+        int cur = y * width + x, best = cur;
+        int offsets[] = {-width, width, -1, 1};
+        for (int offset : offsets) {
+            int next = cur + offset;
+            if (field[next] < field[best]) best = next;
+        }
+        return {best % width - x, best / width - y};
+    }
+
+private:
+    bool supported(int cell) const {
+        int offsets[] = {-width, width, -1, 1};
+        for (int offset : offsets)
+            if (field[cell + offset] == field[cell] - 1) return true;
+        return false;
+    }
+};
+
+class Enemy : public Unit {
+private:
+    const Maze* maze;
+    const ChaseField* field;
+
+public:
+    Enemy(int startX, int startY, const Maze& maze, const ChaseField& field)
+        : Unit(startX, startY), maze(&maze), field(&field) {}
+
+    void update() override {
+        auto [dx, dy] = field->nextStep(x, y);
+        if (dx != 0 || dy != 0) move(dx, dy, *maze);
+        else isMoving = false;
     }
 
-    void draw(sf::RenderWindow& window) override {
-        sprite.setPosition(x * TILE_SIZE, y * TILE_SIZE);
-        window.draw(sprite);
+    void draw(SpriteBatch& batch) const override {
+        batch.submit(SQUARE_SLOT, sf::FloatRect(x * TILE_SIZE + 8, y * TILE_SIZE + 8, TILE_SIZE - 16, TILE_SIZE - 16),
+                     sf::Color(200, 30, 30));
     }
 };
+
 class GameUI {
 private:
     sf::Font font;
-    sf::RectangleShape playButton, exitButton;
-    sf::Text playText, exitText;
-    sf::Text timeText, resultText;
+    sf::RectangleShape playButton, modeButton, exitButton;
+    sf::Text playText, modeText, exitText;
+    sf::Text timeText, statusText, resultText, statsText;
 
 public:
     GameUI() {
@@ -251,8 +2848,10 @@ public:
         }
 
         playButton.setSize({300, 80});
+        modeButton.setSize({300, 80});
         exitButton.setSize({300, 80});
         playButton.setFillColor(sf::Color(100, 200, 100));
+        modeButton.setFillColor(sf::Color(100, 100, 200));
         exitButton.setFillColor(sf::Color(200, 100, 100));
 
         playText.setFont(font);
@@ -264,19 +2863,40 @@ public:
         playText.setFillColor(sf::Color::White);
         exitText.setFillColor(sf::Color::White);
 
+        modeText.setFont(font);
+        modeText.setCharacterSize(40);
+        modeText.setFillColor(sf::Color::White);
+        setModeName(GAME_MODE_NAMES[CLASSIC]);
+
         timeText.setFont(font);
         timeText.setCharacterSize(30);
         timeText.setFillColor(sf::Color::White);
 
+        statusText.setFont(font);
+        statusText.setCharacterSize(30);
+        statusText.setFillColor(sf::Color::White);
+
         resultText.setFont(font);
         resultText.setCharacterSize(60);
         resultText.setFillColor(sf::Color::White);
+
+        statsText.setFont(font);
+        statsText.setCharacterSize(24);
+        statsText.setFillColor(sf::Color::Yellow);
+    }
+
+    void setModeName(const string& name) {
+        modeText.setString(name);
     }
 
     void updateTimeText(float seconds) {
         timeText.setString("Time: " + to_string((int)seconds));
     }
 
+    void setStatusText(const string& text) {
+        statusText.setString(text);
+    }
+
     void updateResultText(float seconds) {
         stringstream ss;
         ss << "Finished in " << seconds << " seconds!";
@@ -284,123 +2904,477 @@ public:
         resultText.setPosition(1920 / 2 - resultText.getLocalBounds().width / 2, 1080 / 2 - 50);
     }
 
-    void drawMainMenu(sf::RenderWindow& window) {
+    void updateCaughtText(float seconds) {
+        stringstream ss;
+        ss << "Caught after " << seconds << " seconds!";
+        resultText.setString(ss.str());
+        resultText.setPosition(1920 / 2 - resultText.getLocalBounds().width / 2, 1080 / 2 - 50);
+    }
+
+    void drawMainMenu(CountingWindow& window) {
         playButton.setPosition(window.getSize().x / 2 - 150, 400);
         playText.setPosition(playButton.getPosition().x + 100, playButton.getPosition().y + 15);
-        exitButton.setPosition(window.getSize().x / 2 - 150, 500);
+        modeButton.setPosition(window.getSize().x / 2 - 150, 500);
+        modeText.setPosition(modeButton.getPosition().x + (300 - modeText.getLocalBounds().width) / 2,
+                             modeButton.getPosition().y + 20);
+        exitButton.setPosition(window.getSize().x / 2 - 150, 600);
         exitText.setPosition(exitButton.getPosition().x + 100, exitButton.getPosition().y + 15);
 
         window.draw(playButton);
         window.draw(playText);
+        window.draw(modeButton);
+        window.draw(modeText);
         window.draw(exitButton);
         window.draw(exitText);
     }
 
-    void drawGameUI(sf::RenderWindow& window) {
+    void drawGameUI(CountingWindow& window) {
         timeText.setPosition(1600, 20);
         window.draw(timeText);
+        statusText.setPosition(1600, 60);
+        window.draw(statusText);
     }
 
-    void drawResult(sf::RenderWindow& window) {
+    void drawResult(CountingWindow& window) {
         window.draw(resultText);
     }
 
-    bool isPlayButtonClicked(sf::RenderWindow& window, sf::Event& event) {
-        sf::Vector2f mousePos = window.mapPixelToCoords(sf::Mouse::getPosition(window));
-        playButton.setPosition(window.getSize().x / 2 - 150, 400);
-        return playButton.getGlobalBounds().contains(mousePos);
+    void drawStats(CountingWindow& window, const string& text) {
+        statsText.setString(text);
+        statsText.setPosition(20, 20);
+        window.draw(statsText);
+    }
+
+    bool isPlayButtonClicked(const sf::RenderWindow& window, const sf::Event& event) const {
+        return buttonHit(window, event, 400);
+    }
+
+    bool isModeButtonClicked(const sf::RenderWindow& window, const sf::Event& event) const {
+        return buttonHit(window, event, 500);
+    }
+
+    bool isExitButtonClicked(const sf::RenderWindow& window, const sf::Event& event) const {
+        return buttonHit(window, event, 600);
+    }
+
+private:
+    // Hit tests run on the event thread, so they use the event's own position and the default view
+    // instead of the shapes the render thread is drawing.
+    static bool buttonHit(const sf::RenderWindow& window, const sf::Event& event, float top) {
+        sf::Vector2f mousePos = window.mapPixelToCoords(sf::Vector2i(event.mouseButton.x, event.mouseButton.y), window.getDefaultView());
+        return sf::FloatRect(window.getSize().x / 2 - 150, top, 300, 80).contains(mousePos);
+    }
+};
+
+// Single-producer single-consumer triple buffer. The writer fills its back slot and swaps it into
+// the middle; the reader swaps the middle out only when it holds something newer. Neither side waits
+// on the other for the data, and a snapshot the reader was too slow to take is simply overwritten.
+// A reader with nothing to do can sleep in waitForFresh(); the mutex there only guards the wakeup.
+template <typename T>
+class TripleBuffer {
+private:
+    static const int FRESH = 4;
+    T slots[3];
+    atomic<int> middle{1};
+    int back = 0, front = 2;
+    mutex signalMutex;
+    condition_variable signal;
+    bool closed = false;
+
+public:
+    T& writeSlot() { return slots[back]; }
+
+    void publish() {
+        back = middle.exchange(back | FRESH, memory_order_acq_rel) & 3;
+        { lock_guard<mutex> lock(signalMutex); }
+        signal.notify_one();
+    }
+
+    void waitForFresh() {
+        unique_lock<mutex> lock(signalMutex);
+        signal.wait(lock, [this] { return closed || (middle.load(memory_order_acquire) & FRESH); });
+    }
+
+    // Releases a reader blocked in waitForFresh() for good, so it can shut down.
+    void close() {
+        {
+            lock_guard<mutex> lock(signalMutex);
+            closed = true;
+        }
+        signal.notify_all();
+    }
+
+    bool acquire() {
+        if (!(middle.load(memory_order_acquire) & FRESH)) return false;
+        front = middle.exchange(front, memory_order_acq_rel) & 3;
+        return true;
+    }
+
+    const T& readSlot() const { return slots[front]; }
+};
+
+// Cells edited since the last published frame.
+class ChangeLog : public MazeListener {
+private:
+    Maze& maze;
+    vector<int> cells;
+    int total = 0;
+
+public:
+    explicit ChangeLog(Maze& maze) : maze(maze) {
+        maze.subscribe(this);
+    }
+
+    ~ChangeLog() override {
+        maze.unsubscribe(this);
     }
 
-    bool isExitButtonClicked(sf::RenderWindow& window, sf::Event& event) {
-        sf::Vector2f mousePos = window.mapPixelToCoords(sf::Mouse::getPosition(window));
-        exitButton.setPosition(window.getSize().x / 2 - 150, 500);
-        return exitButton.getGlobalBounds().contains(mousePos);
+    ChangeLog(const ChangeLog&) = delete;
+    ChangeLog& operator=(const ChangeLog&) = delete;
+
+    void onCellChanged(int x, int y) override {
+        cells.push_back(y * maze.getWidth() + x);
+        total++;
     }
+
+    const vector<int>& getCells() const { return cells; }
+    void clear() { cells.clear(); }
+    int getTotal() const { return total; }
+};
+
+// Everything the render thread draws from: one simulation tick, copied out whole. The maze travels
+// as the layout of its generation plus the cell edits the renderer has not acknowledged yet; edits
+// hold absolute values, so seeing one twice is harmless.
+struct FrameSnapshot {
+    struct CellChange {
+        int cell, value, item;
+    };
+
+    long sequence = 0;
+    GameState state = MAIN_MENU;
+    GameMode mode = CLASSIC;
+    int generation = 0;
+    shared_ptr<const Maze> layout;
+    shared_ptr<const vector<pair<int, int>>> doors;
+    vector<CellChange> changes;
+    shared_ptr<const vector<pair<int, int>>> path;
+    int playerX = 0, playerY = 0, playerKeys = 0;
+    SpriteBatch sprites;
+    int seconds = 0;
+    float finishSeconds = 0;
+    bool caught = false;
+    string status;
+    float zoom = 1.0f;
+    bool fullView = false, showStats = false, useShader = true, governor = false;
+    bool dirty = true;
+    size_t key = 0;
 };
 
 class Game {
 private:
-    const int width = 61, height = 61;
+    const int width, height;
     GameState currentState = MAIN_MENU;
-    sf::RenderWindow window;
+    GameMode mode = CLASSIC;
+    CountingWindow window;
 
     Maze maze;
     Player player;
     std::vector<std::pair<int, int>> currentPath;
+    shared_ptr<const vector<pair<int, int>>> sharedPath;
+    int pathVersion = 0;
+    unique_ptr<DStarLite> hintPlanner;
+
+    struct Door {
+        int x, y;
+        float period, phase;
+    };
+    vector<Door> doors;
+
+    // Doors-mode bots race for the exit, each repairing its own D* Lite search as doors toggle.
+    const int doorBotCount = 12;
+    vector<Runner> doorBots;
+    vector<unique_ptr<DStarLite>> botPlanners;
+    sf::Clock doorBotClock;
+
+    const int runnerCount = 150;
+    const float runnerStepDelay = 0.2f;
+    vector<Runner> runners;
+    unique_ptr<CooperativePlanner> runnerPlanner;
+    sf::Clock runnerClock;
+
+    const int enemyCount = 40;
+    const float enemyStepDelay = 0.3f;
+    unique_ptr<ChaseField> chaseField;
+    vector<Enemy> enemies;
+    sf::Clock enemyClock;
 
-    sf::RectangleShape passRect, exitRect;
-    sf::Texture wallTextures[4];
-    sf::Sprite wallSprites[4];
+    const int coinCount = 12;
+    unique_ptr<CoinRoute> coinRoute;
+    int remainingCoins = 0, placedCoins = 0;
+
+    unique_ptr<CorridorTable> corridors;
+    sf::Clock runClock;
+    int runDir = -1;
+
+    unique_ptr<FieldOfView> fov;
+    unique_ptr<ExploreField> exploreField;
+    sf::Clock exploreClock;
+    string statusText;
+    bool caught = false;
 
     sf::Clock gameClock, finishClock;
     sf::Time finishTime;
     bool tHeld = false;
     bool fullView = false;
+    bool useShader = true;
+    float zoom = 1.0f, targetZoom = 1.0f;
+    bool showStats = false;
+    bool governor;
+    bool dirty = true;
+    sf::Clock uptime;
+
+    // Hand-over between the simulation (main) thread and the render thread.
+    TripleBuffer<FrameSnapshot> frames;
+    unique_ptr<ChangeLog> changeLog;
+    shared_ptr<const Maze> layout;
+    shared_ptr<const vector<pair<int, int>>> doorCells;
+    int generation = 0;
+    long sequence = 0, dirtyUntil = 0;
+    deque<pair<long, vector<FrameSnapshot::CellChange>>> unacknowledged;
+    bool quit = false;
+    atomic<bool> running{false};
+    atomic<int> adoptedGeneration{0};
+    atomic<long> consumedSequence{0};
+
+    // Render thread only: its own copy of the maze and everything drawn from it.
+    const FrameSnapshot* frame = nullptr;
+    Maze shownMaze;
+    int shownGeneration = 0;
+    shared_ptr<const vector<pair<int, int>>> shownPath;
+    unique_ptr<FieldOfView> shownFov;
+    unique_ptr<ExploredMap> explored;
+    PathOverlay pathOverlay{sf::Color(255, 255, 128)};
+    sf::RectangleShape exitRect, doorRect, keyRect, lockRect;
+    sf::CircleShape coinShape;
+    sf::Texture tileAtlas, entityAtlas;
+    unique_ptr<WallMasks> wallMasks;
+    unique_ptr<MazeMesh> mazeMesh;
+    unique_ptr<MazePyramid> pyramid;
+    unique_ptr<ShaderTilemap> tilemap;
+    sf::RenderTexture overview;
+    int overviewKeys = -1;
+    // Cells changed since the overview was drawn; a door toggle patches these instead of
+    // redrawing the whole maze.
+    bool overviewValid = false;
+    vector<int> overviewDirty;
+
+    sf::Clock frameClock, workClock;
+    float frameMs = 0, workMs = 0;
+    int frameDrawCalls = 0;
+    bool renderedLastTick = false;
+    sf::Clock redrawClock;
+    int redraws = 0;
+    float redrawsPerSecond = 0;
+
+    CountingTexture world;
+    int pixelScale;
+    sf::Clock governorClock;
+    bool governing = false, steppedDown = false;
+    float stepDownDelay = 3;
 
     GameUI ui;
 
 public:
-    Game() : window(sf::VideoMode(1920, 1080), "Maze"), maze(width, height) {
-        window.setFramerateLimit(60);
+    explicit Game(int size = 61, int pixelScale = 1, bool governor = false)
+        : width(size), height(size), window(sf::VideoMode(1920, 1080), "Maze"), maze(width, height),
+          sharedPath(make_shared<const vector<pair<int, int>>>()), governor(governor), shownMaze(width, height),
+          pixelScale(pixelScale) {
         srand(static_cast<unsigned>(time(NULL)));
 
-        if (!wallTextures[0].loadFromFile("Tiles/FieldsTile_01.png") ||
-            !wallTextures[1].loadFromFile("Tiles/FieldsTile_02.png") ||
-            !wallTextures[2].loadFromFile("Tiles/FieldsTile_03.png") ||
-            !wallTextures[3].loadFromFile("Tiles/FieldsTile_04.png")) {
+        sf::Image wallImages[4];
+        if (!wallImages[0].loadFromFile("Tiles/FieldsTile_01.png") ||
+            !wallImages[1].loadFromFile("Tiles/FieldsTile_02.png") ||
+            !wallImages[2].loadFromFile("Tiles/FieldsTile_03.png") ||
+            !wallImages[3].loadFromFile("Tiles/FieldsTile_04.png")) {
             std::cerr << "Error loading wall textures\n";
             exit(1);
         }
 
-        for (int i = 0; i < 4; ++i) {
-            wallSprites[i].setTexture(wallTextures[i]);
-            wallSprites[i].setScale(
-                TILE_SIZE / static_cast<float>(wallTextures[i].getSize().x),
-                TILE_SIZE / static_cast<float>(wallTextures[i].getSize().y)
-            );
+        // Autotiles: each wall texture is bevelled along the sides whose neighbour is open, so
+        // walls that touch merge into one shape. Floor variants past the first carry a faint
+        // imprint of the matching wall texture under the terrain tint.
+        unsigned tile = wallImages[0].getSize().y;
+        sf::Image atlasImage;
+        atlasImage.create(tile * (MazeMesh::PASS_SLOT + 1), tile * TILE_VARIANTS, sf::Color::White);
+        const unsigned bevel = tile / 8;
+        for (int variant = 0; variant < TILE_VARIANTS; ++variant) {
+            for (int mask = 0; mask < MazeMesh::PASS_SLOT; ++mask) {
+                for (unsigned py = 0; py < tile; ++py) {
+                    for (unsigned px = 0; px < tile; ++px) {
+                        unsigned edge = bevel;
+                        if (!(mask & 1)) edge = min(edge, py);
+                        if (!(mask & 2)) edge = min(edge, tile - 1 - py);
+                        if (!(mask & 4)) edge = min(edge, px);
+                        if (!(mask & 8)) edge = min(edge, tile - 1 - px);
+                        sf::Color color = wallImages[variant].getPixel(px, py);
+                        float shade = 0.45f + 0.55f * edge / bevel;
+                        color.r = static_cast<sf::Uint8>(color.r * shade);
+                        color.g = static_cast<sf::Uint8>(color.g * shade);
+                        color.b = static_cast<sf::Uint8>(color.b * shade);
+                        atlasImage.setPixel(mask * tile + px, variant * tile + py, color);
+                    }
+                }
+            }
+            for (unsigned py = 0; variant > 0 && py < tile; ++py) {
+                for (unsigned px = 0; px < tile; ++px) {
+                    sf::Color color = wallImages[variant].getPixel(px, py);
+                    sf::Uint8 level = 255 - (255 - (color.r + color.g + color.b) / 3) / 5;
+                    atlasImage.setPixel(MazeMesh::PASS_SLOT * tile + px, variant * tile + py, sf::Color(level, level, level));
+                }
+            }
+        }
+        tileAtlas.loadFromImage(atlasImage);
+
+        sf::Image slime;
+        if (!slime.loadFromFile("Tiles/slime1.png")) {
+            std::cerr << "Error loading texture: Tiles/slime1.png\n";
+            exit(1);
         }
+        unsigned frame = slime.getSize().y;
+        sf::Image entityImage;
+        entityImage.create(frame * ENTITY_SLOTS, frame, sf::Color::Transparent);
+        for (int i = 0; i < SLIME_FRAMES; ++i) {
+            string path = "Tiles/slime" + to_string(i + 1) + ".png";
+            if (!slime.loadFromFile(path)) {
+                std::cerr << "Error loading texture: " << path << "\n";
+                exit(1);
+            }
+            entityImage.copy(slime, i * frame, 0, sf::IntRect(0, 0, frame, frame));
+        }
+        float radius = frame / 2.f;
+        for (unsigned y = 0; y < frame; ++y) {
+            for (unsigned x = 0; x < frame; ++x) {
+                float dx = x + 0.5f - radius, dy = y + 0.5f - radius;
+                if (dx * dx + dy * dy <= radius * radius) entityImage.setPixel(CIRCLE_SLOT * frame + x, y, sf::Color::White);
+                entityImage.setPixel(SQUARE_SLOT * frame + x, y, sf::Color::White);
+            }
+        }
+        entityAtlas.loadFromImage(entityImage);
 
-        passRect.setSize({TILE_SIZE, TILE_SIZE});
         exitRect.setSize({TILE_SIZE, TILE_SIZE});
-        passRect.setFillColor(sf::Color::White);
         exitRect.setFillColor(sf::Color::Green);
+
+        doorRect.setSize({TILE_SIZE - 8, TILE_SIZE - 8});
+        doorRect.setFillColor(sf::Color::Transparent);
+        doorRect.setOutlineColor(sf::Color(255, 140, 0));
+        doorRect.setOutlineThickness(4);
+
+        keyRect.setSize({TILE_SIZE / 2, TILE_SIZE / 2});
+        keyRect.setOutlineColor(sf::Color::Black);
+        keyRect.setOutlineThickness(2);
+        lockRect.setSize({TILE_SIZE - 6, TILE_SIZE - 6});
+        lockRect.setOutlineThickness(3);
+
+        coinShape.setRadius(TILE_SIZE / 4);
+        coinShape.setFillColor(sf::Color(255, 215, 0));
+        coinShape.setOutlineColor(sf::Color(160, 120, 0));
+        coinShape.setOutlineThickness(2);
     }
 
+    // The main thread samples input and steps the simulation at a fixed 60 Hz, publishing a snapshot
+    // per tick; drawing happens on its own thread, so a slow display() or vsync wait never delays a tick.
+    // The idle menu blocks in waitEvent.
     void run() {
-        while (window.isOpen()) {
+        window.setActive(false);
+        running = true;
+        thread renderer(&Game::renderLoop, this);
+        const sf::Time tick = sf::seconds(1.f / 60);
+        sf::Clock clock;
+        sf::Time deadline = clock.getElapsedTime();
+        while (!quit) {
+            if (currentState == MAIN_MENU && !dirty && !showStats) {
+                sf::Event event;
+                if (window.waitEvent(event)) handleEvent(event);
+                deadline = clock.getElapsedTime();
+            }
             processEvents();
             update();
-            render();
+            publishFrame();
+            // Ticks are scheduled on absolute deadlines so sleep overshoot does not pile up; after a
+            // long stall the schedule restarts instead of running a burst of catch-up ticks.
+            deadline += tick;
+            sf::Time now = clock.getElapsedTime();
+            if (deadline > now) sf::sleep(deadline - now);
+            else if (now - deadline > tick * 6.f) deadline = now;
         }
+        running = false;
+        frames.close();
+        renderer.join();
+        window.close();
     }
 
 private:
     void processEvents() {
         sf::Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == sf::Event::Closed) {
-                window.close();
-            }
+        while (window.pollEvent(event))
+            handleEvent(event);
+    }
 
-            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape) {
-                if (currentState == PLAYING)
-                    currentState = MAIN_MENU;
-            }
+    void handleEvent(sf::Event& event) {
+        dirty = true;
+        if (event.type == sf::Event::Closed) {
+            quit = true;
+        }
 
-            if (currentState == MAIN_MENU && event.type == sf::Event::MouseButtonPressed) {
-                if (ui.isPlayButtonClicked(window, event)) {
-                    startNewGame();
-                } else if (ui.isExitButtonClicked(window, event)) {
-                    window.close();
-                }
-            } else if (currentState == PLAYING) {
-                handleGameInput(event);
+        if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+            showStats = !showStats;
+        }
+
+        if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F4) {
+            useShader = !useShader;
+        }
+
+        if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F5) {
+            governor = !governor;
+        }
+
+        if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Escape) {
+            if (currentState == PLAYING)
+                currentState = MAIN_MENU;
+        }
+
+        if (currentState == MAIN_MENU && event.type == sf::Event::MouseButtonPressed) {
+            if (ui.isPlayButtonClicked(window, event)) {
+                startNewGame();
+            } else if (ui.isModeButtonClicked(window, event)) {
+                mode = static_cast<GameMode>((mode + 1) % GAME_MODE_COUNT);
+            } else if (ui.isExitButtonClicked(window, event)) {
+                quit = true;
             }
+        } else if (currentState == PLAYING) {
+            handleGameInput(event);
         }
     }
 
     void startNewGame() {
+        changeLog.reset();
+        corridors.reset();
+        exploreField.reset();
+        fov.reset();
+        hintPlanner.reset();
+        runnerPlanner.reset();
+        doors.clear();
+        doorBots.clear();
+        botPlanners.clear();
+        runners.clear();
+        enemies.clear();
+        chaseField.reset();
+        coinRoute.reset();
+        remainingCoins = placedCoins = 0;
+        statusText.clear();
+        caught = false;
         maze.generate();
+        maze.scatterTerrain();
         player = Player(1, 1);
 
         while (maze.get(player.getX(), player.getY()) != PASS) {
@@ -414,14 +3388,237 @@ private:
             }
         }
 
+        if (mode == DYNAMIC_WALLS) {
+            placeDoors();
+            spawnDoorBots();
+        }
+        if (mode == RACE)
+            spawnRunners();
+        if (mode == CHASE)
+            spawnEnemies();
+        if (mode == KEYS) {
+            // A small maze sometimes has no room for every key; deal fresh layouts, and only after
+            // many misses settle for fewer keys. Odd cells are always carved, so the start stays open.
+            for (int attempt = 1, keys = MAX_KEYS; !maze.placeKeysAndDoors(player.getX(), player.getY(), keys); ++attempt) {
+                maze.generate();
+                maze.scatterTerrain();
+                if (attempt % 20 == 0 && keys > 0) keys--;
+            }
+        }
+        if (mode == COINS)
+            scatterCoins();
+        if (mode == EXPLORE)
+            exploreField = make_unique<ExploreField>(maze);
+        vector<pair<int, int>> doorList;
+        for (const Door& door : doors) doorList.emplace_back(door.x, door.y);
+        maze.setVariants(TileDecorator(maze, maze.getSeed()).solve(doorList));
+        corridors = make_unique<CorridorTable>(maze);
+        fov = make_unique<FieldOfView>(maze, VIEW_RADIUS);
+        zoom = targetZoom = 1.0f;
+        fov->compute(player.getX(), player.getY());
+
+        auto copy = make_shared<Maze>(width, height);
+        copy->copyFrom(maze);
+        layout = copy;
+        doorCells = make_shared<const vector<pair<int, int>>>(move(doorList));
+        changeLog = make_unique<ChangeLog>(maze);
+        unacknowledged.clear();
+        generation++;
+
         gameClock.restart();
-        currentPath.clear();
+        setPath({});
         currentState = PLAYING;
     }
 
+    void placeDoors() {
+        const int count = width * height / 60;
+        for (int attempts = 0; (int)doors.size() < count && attempts < count * 20; ++attempts) {
+            int x = rand() % (width - 2) + 1, y = rand() % (height - 2) + 1;
+            if ((x + y) % 2 == 0) continue;
+            bool linksCells = x % 2 == 0 ? !maze.isWall(x - 1, y) && !maze.isWall(x + 1, y)
+                                         : !maze.isWall(x, y - 1) && !maze.isWall(x, y + 1);
+            bool taken = any_of(doors.begin(), doors.end(), [&](const Door& d) { return d.x == x && d.y == y; });
+            if (linksCells && !taken)
+                doors.push_back({x, y, 3.0f + rand() % 6, (rand() % 100) / 10.0f});
+        }
+    }
+
+    // Every planner keeps search state for the whole maze, so big boards get fewer bots.
+    void spawnDoorBots() {
+        int count = min(doorBotCount, max(1, (1 << 22) / (width * height)));
+        for (int attempts = 0; (int)doorBots.size() < count && attempts < count * 50; ++attempts) {
+            int x = rand() % width, y = rand() % height;
+            if (maze.isWall(x, y) || (x == player.getX() && y == player.getY()) || (x == width - 2 && y == height - 2))
+                continue;
+            doorBots.emplace_back((int)doorBots.size(), x, y);
+            botPlanners.push_back(make_unique<DStarLite>(maze, x, y, width - 2, height - 2));
+        }
+        doorBotClock.restart();
+    }
+
+    void updateDoorBots() {
+        if (doorBots.empty() || doorBotClock.getElapsedTime().asSeconds() < runnerStepDelay) return;
+        doorBotClock.restart();
+        for (size_t i = 0; i < doorBots.size();) {
+            Runner& bot = doorBots[i];
+            botPlanners[i]->setStart(bot.getX(), bot.getY());
+            auto [nextY, nextX] = botPlanners[i]->nextStep();
+            bot.move(nextX - bot.getX(), nextY - bot.getY(), maze);
+            bot.update();
+            if (bot.getX() == width - 2 && bot.getY() == height - 2) {
+                doorBots.erase(doorBots.begin() + i);
+                botPlanners.erase(botPlanners.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    void spawnRunners() {
+        runnerPlanner = make_unique<CooperativePlanner>(maze, width - 2, height - 2, runnerCount);
+        vector<char> taken(width * height, 0);
+        taken[player.getY() * width + player.getX()] = 1;
+        taken[(height - 2) * width + width - 2] = 1;
+        for (int attempts = 0; (int)runners.size() < runnerCount && attempts < runnerCount * 20; ++attempts) {
+            int x = rand() % width, y = rand() % height;
+            if (maze.isWall(x, y) || taken[y * width + x]) continue;
+            taken[y * width + x] = 1;
+            runners.emplace_back((int)runners.size(), x, y);
+            runnerPlanner->add(runners.back());
+        }
+        runnerClock.restart();
+    }
+
+    void updateRunners() {
+        if (!runnerPlanner || runnerClock.getElapsedTime().asSeconds() < runnerStepDelay) return;
+        runnerClock.restart();
+        runnerPlanner->step(runners, player.getX(), player.getY());
+        for (size_t i = 0; i < runners.size();) {
+            runners[i].update();
+            if (runnerPlanner->hasArrived(runners[i])) {
+                runnerPlanner->remove(runners[i]);
+                runners.erase(runners.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    void scatterCoins() {
+        vector<pair<int, int>> coins = maze.scatterCoins(coinCount, player.getX(), player.getY());
+        coinRoute = make_unique<CoinRoute>(maze, coins, width - 2, height - 2);
+        // A small or crowded maze may hold fewer coins than asked for.
+        placedCoins = coins.size();
+        remainingCoins = coinRoute->allCoins();
+        updateCoinStatus();
+    }
+
+    void updateCoinStatus() {
+        int left = 0;
+        for (int bits = remainingCoins; bits; bits &= bits - 1) left++;
+        statusText = "Coins: " + to_string(placedCoins - left) + "/" + to_string(placedCoins);
+    }
+
+    void movePlayer(int dx, int dy) {
+        player.setPlannedPath({});
+        player.move(dx, dy, maze);
+        collectItems();
+    }
+
+    // A run queues the corridor up to the next stop and walks it at the normal pace, so terrain
+    // delays, items and enemies all apply on every tile. Held keys repeat; those are ignored
+    // until the run is over.
+    void runPlayer(int dir) {
+        if (exploreField || (dir == runDir && !player.getPlannedPath().empty())) return;
+        vector<pair<int, int>> steps = corridors->runPath(player.getX(), player.getY(), dir);
+        if (!steps.empty() && !maze.isPassable(steps.back().second, steps.back().first, player.getKeys()))
+            steps.pop_back();
+        if (steps.empty()) return;
+        runDir = dir;
+        player.setPlannedPath(steps);
+    }
+
+    void updateRun() {
+        if (exploreField || player.getPlannedPath().empty()) return;
+        if (runClock.getElapsedTime().asSeconds() <= player.getStepDelay()) return;
+        runClock.restart();
+        auto [nextY, nextX] = player.getPlannedPath().front();
+        player.followPlannedPath(maze);
+        if (player.getX() != nextX || player.getY() != nextY) player.setPlannedPath({});
+        collectItems();
+    }
+
+    void collectItems() {
+        if (coinRoute && maze.getItem(player.getX(), player.getY()) == COIN_ITEM) {
+            maze.setItem(player.getX(), player.getY(), NO_ITEM);
+            remainingCoins &= ~(1 << coinRoute->coinAt(player.getX(), player.getY()));
+            updateCoinStatus();
+            if (!currentPath.empty())
+                setPath(coinRoute->hint(player.getX(), player.getY(), remainingCoins));
+        }
+    }
+
+    void spawnEnemies() {
+        chaseField = make_unique<ChaseField>(maze, player.getX(), player.getY(), player.getSteps());
+        for (int attempts = 0; (int)enemies.size() < enemyCount && attempts < enemyCount * 50; ++attempts) {
+            int x = rand() % width, y = rand() % height;
+            if (!maze.isWall(x, y) && chaseField->distance(x, y) >= 20)
+                enemies.emplace_back(x, y, maze, *chaseField);
+        }
+        enemyClock.restart();
+    }
+
+    void updateEnemies() {
+        if (!chaseField) return;
+        chaseField->movePlayer(player.getX(), player.getY(), player.getSteps());
+        if (enemyClock.getElapsedTime().asSeconds() >= enemyStepDelay) {
+            enemyClock.restart();
+            for (Enemy& enemy : enemies)
+                enemy.update();
+        }
+        for (const Enemy& enemy : enemies) {
+            if (enemy.getX() == player.getX() && enemy.getY() == player.getY()) {
+                finishTime = gameClock.getElapsedTime();
+                finishClock.restart();
+                currentState = FINISHED;
+                caught = true;
+                return;
+            }
+        }
+    }
+
+    void updateExplorer() {
+        if (!exploreField) return;
+        fov->compute(player.getX(), player.getY());
+        exploreField->reveal(*fov);
+        exploreField->repair(EXPLORE_REPAIR_BUDGET);
+        if (!exploreField->isSettled() || exploreClock.getElapsedTime().asSeconds() < player.getStepDelay()) return;
+        exploreClock.restart();
+        if (exploreField->isDone(player.getX(), player.getY())) {
+            if (player.getPlannedPath().empty())
+                player.setPlannedPath(maze.findShortestPath(player.getX(), player.getY(), width - 2, height - 2, JPS));
+            player.followPlannedPath(maze);
+        } else {
+            auto [dx, dy] = exploreField->nextStep(player.getX(), player.getY());
+            movePlayer(dx, dy);
+        }
+        long long percent = 100LL * exploreField->getExploredCells() / max(1, exploreField->getOpenCells());
+        statusText = "Explored: " + to_string(percent) + "%";
+    }
+
+    void updateDoors() {
+        float t = gameClock.getElapsedTime().asSeconds();
+        for (const Door& door : doors) {
+            bool open = fmod(t + door.phase, door.period) < door.period / 2;
+            bool occupied = door.x == player.getX() && door.y == player.getY();
+            for (const Runner& bot : doorBots) occupied |= bot.getX() == door.x && bot.getY() == door.y;
+            if (!open && occupied) continue;
+            maze.set(door.x, door.y, open ? PASS : WALL);
+        }
+    }
+
     void handleGameInput(sf::Event& event) {
         static sf::Clock moveClock;
-        const float moveDelay = 0.15f;
 
         if (event.type == sf::Event::KeyPressed) {
             if (event.key.code == sf::Keyboard::Tab) {
@@ -429,29 +3626,53 @@ private:
             }
             if (event.key.code == sf::Keyboard::T) {
                 tHeld = true;
-                currentPath = maze.findShortestPath(player.getX(), player.getY(), width - 2, height - 2);
+                if (mode == DYNAMIC_WALLS) {
+                    hintPlanner = make_unique<DStarLite>(maze, player.getX(), player.getY(), width - 2, height - 2);
+                    setPath(hintPlanner->getPath());
+                } else if (mode == COINS) {
+                    setPath(coinRoute->hint(player.getX(), player.getY(), remainingCoins));
+                } else if (mode == KEYS) {
+                    setPath(maze.findPathWithKeys(player.getX(), player.getY(), player.getKeys(), width - 2, height - 2));
+                } else {
+                    setPath(maze.findCheapestPath(player.getX(), player.getY(), width - 2, height - 2));
+                }
             }
             if (event.key.code == sf::Keyboard::R) {
-                currentPath.clear();
+                hintPlanner.reset();
+                setPath({});
+            }
+            if (event.key.shift) {
+                if (event.key.code == sf::Keyboard::W) runPlayer(0);
+                if (event.key.code == sf::Keyboard::S) runPlayer(1);
+                if (event.key.code == sf::Keyboard::A) runPlayer(2);
+                if (event.key.code == sf::Keyboard::D) runPlayer(3);
             }
         }
 
+        if (event.type == sf::Event::MouseWheelScrolled) {
+            float fitZoom = max({1.0f, width * TILE_SIZE / 1920.f, height * TILE_SIZE / 1080.f});
+            targetZoom = min(fitZoom, max(0.5f, targetZoom * pow(1.15f, -event.mouseWheelScroll.delta)));
+        }
+
         if (event.type == sf::Event::KeyReleased && event.key.code == sf::Keyboard::T) {
             tHeld = false;
         }
 
-        if (moveClock.getElapsedTime().asSeconds() > moveDelay) {
+        if (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) || sf::Keyboard::isKeyPressed(sf::Keyboard::RShift))
+            return;
+
+        if (moveClock.getElapsedTime().asSeconds() > player.getStepDelay()) {
             if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) {
-                player.move(0, -1, maze);
+                movePlayer(0, -1);
             }
             if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) {
-                player.move(0, 1, maze);
+                movePlayer(0, 1);
             }
             if (sf::Keyboard::isKeyPressed(sf::Keyboard::A)) {
-                player.move(-1, 0, maze);
+                movePlayer(-1, 0);
             }
             if (sf::Keyboard::isKeyPressed(sf::Keyboard::D)) {
-                player.move(1, 0, maze);
+                movePlayer(1, 0);
             }
             moveClock.restart();
         }
@@ -459,69 +3680,422 @@ private:
 
     void update() {
         if (currentState == PLAYING) {
-            if (player.getX() == width - 2 && player.getY() == height - 2) {
+            if (player.getX() == width - 2 && player.getY() == height - 2 && remainingCoins == 0) {
                 finishTime = gameClock.getElapsedTime();
                 finishClock.restart();
                 currentState = FINISHED;
-                ui.updateResultText(finishTime.asSeconds());
+            }
+            updateDoors();
+            updateDoorBots();
+            updateRun();
+            updateRunners();
+            updateEnemies();
+            updateExplorer();
+            if (hintPlanner) {
+                hintPlanner->setStart(player.getX(), player.getY());
+                setPath(hintPlanner->getPath());
             }
             player.update();
-            ui.updateTimeText(gameClock.getElapsedTime().asSeconds());
+            zoom += (targetZoom - zoom) * 0.2f;
+            if (fabs(targetZoom - zoom) < 0.001f) zoom = targetZoom;
         } else if (currentState == FINISHED && finishClock.getElapsedTime().asSeconds() >= 5) {
             currentState = MAIN_MENU;
         }
     }
 
+    void publishFrame() {
+        if (fov) fov->compute(player.getX(), player.getY());
+        if (layout && adoptedGeneration == generation) layout.reset();
+
+        long consumed = consumedSequence;
+        while (!unacknowledged.empty() && unacknowledged.front().first <= consumed) unacknowledged.pop_front();
+        sequence++;
+        if (changeLog && !changeLog->getCells().empty()) {
+            vector<FrameSnapshot::CellChange> batch;
+            for (int cell : changeLog->getCells())
+                batch.push_back({cell, maze.get(cell % width, cell / width), maze.getItem(cell % width, cell / width)});
+            changeLog->clear();
+            unacknowledged.emplace_back(sequence, move(batch));
+        }
+        if (dirty) dirtyUntil = sequence;
+        dirty = false;
+
+        FrameSnapshot& next = frames.writeSlot();
+        next.sequence = sequence;
+        next.changes.clear();
+        for (const auto& batch : unacknowledged)
+            next.changes.insert(next.changes.end(), batch.second.begin(), batch.second.end());
+        next.dirty = dirtyUntil > consumed;
+        next.state = currentState;
+        next.mode = mode;
+        next.generation = generation;
+        next.layout = layout;
+        next.doors = doorCells;
+        next.path = sharedPath;
+        next.playerX = player.getX();
+        next.playerY = player.getY();
+        next.playerKeys = player.getKeys();
+        next.sprites.setAtlas(entityAtlas);
+        next.sprites.clear();
+        if (currentState == PLAYING) {
+            for (const Runner& runner : runners)
+                if (fullView || fov->isVisible(runner.getX(), runner.getY())) runner.draw(next.sprites);
+            for (const Runner& bot : doorBots)
+                if (fullView || fov->isVisible(bot.getX(), bot.getY())) bot.draw(next.sprites);
+            for (const Enemy& enemy : enemies)
+                if (fullView || fov->isVisible(enemy.getX(), enemy.getY())) enemy.draw(next.sprites);
+            player.draw(next.sprites);
+        }
+        next.seconds = static_cast<int>(gameClock.getElapsedTime().asSeconds());
+        next.finishSeconds = finishTime.asSeconds();
+        next.caught = caught;
+        next.status = statusText;
+        next.zoom = zoom;
+        next.fullView = fullView;
+        next.showStats = showStats;
+        next.useShader = useShader;
+        next.governor = governor;
+        next.key = sceneKey();
+        frames.publish();
+    }
+
+    // Hash of everything a frame shows that can change without an input event.
+    size_t sceneKey() const {
+        size_t key = currentState;
+        auto mix = [&key](size_t value) { key = (key ^ value) * 1099511628211ull; };
+        if (showStats) mix(uptime.getElapsedTime().asMilliseconds() / 1000);
+        if (currentState != PLAYING) return key;
+
+        uint32_t zoomBits;
+        memcpy(&zoomBits, &zoom, sizeof(zoomBits));
+        mix(zoomBits);
+        mix(static_cast<size_t>(gameClock.getElapsedTime().asSeconds()));
+        mix(player.getX());
+        mix(player.getY());
+        mix(player.getFrame());
+        mix(player.getKeys());
+        mix(generation);
+        mix(changeLog->getTotal());
+        mix(remainingCoins);
+        mix(pathVersion);
+        for (const Runner& runner : runners) mix(runner.getY() * width + runner.getX());
+        for (const Runner& bot : doorBots) mix(bot.getY() * width + bot.getX());
+        for (const Enemy& enemy : enemies) mix(enemy.getY() * width + enemy.getX());
+        return key;
+    }
+
+    // Draws whenever a new snapshot differs from the one on screen or carries input; the pixel
+    // scale, stats and GPU caches all live on this thread.
+    void renderLoop() {
+        window.setActive(true);
+        size_t drawnKey = 0;
+        while (running) {
+            frames.waitForFresh();
+            if (!frames.acquire()) continue;
+            frame = &frames.readSlot();
+            consumedSequence = frame->sequence;
+            applyFrame();
+            bool redraw = frame->dirty || frame->key != drawnKey;
+            if (redraw) {
+                render();
+                drawnKey = frame->key;
+            }
+            renderedLastTick = redraw;
+        }
+        window.setActive(false);
+    }
+
+    // A new generation is copied whole from its layout; after that only edited cells are replayed,
+    // which notifies the render-side caches just as the live maze would.
+    void applyFrame() {
+        if (frame->generation != shownGeneration && frame->layout) {
+            tilemap.reset();
+            pyramid.reset();
+            mazeMesh.reset();
+            wallMasks.reset();
+            explored.reset();
+            shownFov.reset();
+            shownMaze.copyFrom(*frame->layout);
+            shownGeneration = frame->generation;
+            adoptedGeneration = shownGeneration;
+            shownFov = make_unique<FieldOfView>(shownMaze, VIEW_RADIUS);
+            explored = make_unique<ExploredMap>(shownMaze);
+            wallMasks = make_unique<WallMasks>(shownMaze);
+            mazeMesh = make_unique<MazeMesh>(shownMaze, tileAtlas, *wallMasks);
+            pyramid = make_unique<MazePyramid>(shownMaze);
+            tilemap = make_unique<ShaderTilemap>(shownMaze, tileAtlas, *wallMasks);
+            overviewValid = false;
+        }
+        for (const FrameSnapshot::CellChange& change : frame->changes) {
+            int x = change.cell % width, y = change.cell / width;
+            shownMaze.set(x, y, change.value);
+            shownMaze.setItem(x, y, change.item);
+            if (!overviewValid) continue;
+            // A wall change also retiles its neighbours.
+            int dx[] = {0, 0, 0, -1, 1};
+            int dy[] = {0, -1, 1, 0, 0};
+            for (int d = 0; d < 5; ++d) {
+                int nx = x + dx[d], ny = y + dy[d];
+                if (nx >= 0 && ny >= 0 && nx < width && ny < height) overviewDirty.push_back(ny * width + nx);
+            }
+        }
+        if (overviewDirty.size() > MAX_OVERVIEW_PATCH) {
+            overviewValid = false;
+            overviewDirty.clear();
+        }
+        if (frame->path != shownPath) {
+            shownPath = frame->path;
+            pathOverlay.set(*shownPath);
+        }
+    }
+
     void render() {
+        frameDrawCalls = window.getDrawCalls() + world.getDrawCalls();
+        window.resetDrawCalls();
+        world.resetDrawCalls();
+        float interval = frameClock.restart().asSeconds() * 1000;
+        if (renderedLastTick) frameMs += (interval - frameMs) * 0.1f;
+        redraws++;
+        if (redrawClock.getElapsedTime().asSeconds() >= 1) {
+            redrawsPerSecond = redraws / redrawClock.restart().asSeconds();
+            redraws = 0;
+        }
+        workClock.restart();
+        governFrameRate();
         window.clear();
 
-        if (currentState == MAIN_MENU) {
+        if (frame->state == MAIN_MENU) {
+            ui.setModeName(GAME_MODE_NAMES[frame->mode]);
             window.setView(window.getDefaultView());
             ui.drawMainMenu(window);
-        } else if (currentState == PLAYING) {
-            setGameView();
-            drawGameWorld();
-            window.setView(window.getDefaultView());
+        } else if (frame->state == PLAYING) {
+            ui.updateTimeText(frame->seconds);
+            ui.setStatusText(frame->status);
+            renderWorld();
             ui.drawGameUI(window);
-        } else if (currentState == FINISHED) {
+            drawMinimap();
+        } else if (frame->state == FINISHED) {
+            if (frame->caught) ui.updateCaughtText(frame->finishSeconds);
+            else ui.updateResultText(frame->finishSeconds);
             window.setView(window.getDefaultView());
             ui.drawResult(window);
         }
 
+        if (frame->showStats) {
+            stringstream ss;
+            ss << fixed << setprecision(2) << frameMs << " ms (" << workMs << " busy)  " << frameDrawCalls << " draw calls  "
+               << (frame->useShader && tilemap && tilemap->isReady() ? "shader" : "mesh") << "  "
+               << pixelScale << "x" << (frame->governor ? " auto" : "") << "  "
+               << setprecision(1) << redrawsPerSecond << " redraws/s";
+            window.setView(window.getDefaultView());
+            ui.drawStats(window, ss.str());
+        }
+
         window.display();
+        workMs += (workClock.getElapsedTime().asSeconds() * 1000 - workMs) * 0.1f;
+    }
+
+    // The world is drawn at 1/pixelScale of the window and blown up without filtering, so each
+    // world pixel becomes a crisp pixelScale x pixelScale block.
+    void renderWorld() {
+        sf::Vector2u size((window.getSize().x + pixelScale - 1) / pixelScale, (window.getSize().y + pixelScale - 1) / pixelScale);
+        if (world.getSize() != size) world.create(size.x, size.y);
+        world.clear();
+        setGameView();
+        drawGameWorld();
+        world.display();
+
+        sf::Sprite image(world.getTexture());
+        image.setScale(pixelScale, pixelScale);
+        window.setView(window.getDefaultView());
+        window.draw(image);
+    }
+
+    // Frames are timed through display(), where a GPU-bound frame waits for the driver. The scale
+    // steps up as soon as they run over budget, and back down once the finer scale, assuming its cost
+    // grows with the pixel count, would fit in 60% of it. A step down that has to be undone within
+    // ten seconds doubles the wait before the next one, so a borderline machine settles instead of
+    // flipping between two scales.
+    void governFrameRate() {
+        if (!frame->governor) {
+            governing = false;
+            return;
+        }
+        if (!governing) {
+            governing = true;
+            governorClock.restart();
+            return;
+        }
+        float settled = governorClock.getElapsedTime().asSeconds();
+        if (settled >= 1 && workMs > FRAME_BUDGET_MS * 1.1f && pixelScale < MAX_PIXEL_SCALE) {
+            stepDownDelay = steppedDown && settled < 10 ? min(stepDownDelay * 2, 60.f) : 3.f;
+            steppedDown = false;
+            pixelScale++;
+            governorClock.restart();
+        } else if (settled >= stepDownDelay && pixelScale > 1) {
+            float ratio = float(pixelScale) / (pixelScale - 1);
+            if (workMs * ratio * ratio < FRAME_BUDGET_MS * 0.6f) {
+                steppedDown = true;
+                pixelScale--;
+                governorClock.restart();
+            }
+        }
     }
 
     void setGameView() {
         sf::View view;
-        if (fullView) {
+        if (frame->fullView) {
             view.setSize(width * TILE_SIZE, height * TILE_SIZE);
             view.setCenter(width * TILE_SIZE / 2.f, height * TILE_SIZE / 2.f);
         } else {
-            view.setSize(1920.f, 1080.f);
+            int halfW = 1920 * frame->zoom / 2, halfH = 1080 * frame->zoom / 2;
+            view.setSize(2 * halfW, 2 * halfH);
             view.setCenter(
-                clamp(player.getX() * TILE_SIZE, 1920 / 2, width * TILE_SIZE - 1920 / 2),
-                clamp(player.getY() * TILE_SIZE, 1080 / 2, height * TILE_SIZE - 1080 / 2)
+                halfW * 2 >= width * TILE_SIZE ? width * TILE_SIZE / 2 : clamp(frame->playerX * TILE_SIZE, halfW, width * TILE_SIZE - halfW),
+                halfH * 2 >= height * TILE_SIZE ? height * TILE_SIZE / 2 : clamp(frame->playerY * TILE_SIZE, halfH, height * TILE_SIZE - halfH)
             );
         }
-        window.setView(view);
+        world.setView(view);
     }
 
     void drawGameWorld() {
-        maze.draw(window, wallSprites, passRect, player.getX(), player.getY(), fullView);
+        shownFov->compute(frame->playerX, frame->playerY);
+        explored->reveal(*shownFov);
+        mazeMesh->update(*shownFov, explored->getExplored());
 
-        sf::RectangleShape pathRect(sf::Vector2f(TILE_SIZE, TILE_SIZE));
-        pathRect.setFillColor(sf::Color(255, 255, 128));
-        for (const auto& p : currentPath) {
-            if (fullView || (abs(p.first - player.getY()) <= VIEW_RADIUS && abs(p.second - player.getX()) <= VIEW_RADIUS)) {
-                pathRect.setPosition(p.second * TILE_SIZE, p.first * TILE_SIZE);
-                window.draw(pathRect);
+        if (frame->fullView) {
+            drawOverview();
+            pathOverlay.draw(world, visibleCellRect(world.getView(), width, height), nullptr);
+        } else {
+            float cellPixels = screenCellPixels();
+            if (cellPixels < LOD_CELL_PIXELS) {
+                pyramid->draw(world, cellPixels);
+                mazeMesh->drawFog(world);
+            } else if (frame->useShader && tilemap->isReady()) {
+                tilemap->draw(world, mazeMesh->getFog());
+            } else {
+                mazeMesh->draw(world, visibleCellRect(world.getView(), width, height));
             }
+            sf::IntRect cells = litCellRect();
+            pathOverlay.draw(world, cells, &mazeMesh->getSight());
+            drawItems(world, cells);
+            drawDoors(world);
         }
 
         exitRect.setPosition((width - 2) * TILE_SIZE, (height - 2) * TILE_SIZE);
-        window.draw(exitRect);
+        world.draw(exitRect);
+        frame->sprites.draw(world);
+    }
 
-        player.draw(window);
+    void drawMinimap() {
+        const float scale = float(MINIMAP_SIZE) / max(width, height);
+        sf::Vector2f origin(1920 - MINIMAP_SIZE - 20, 1080 - MINIMAP_SIZE - 20);
+        sf::RectangleShape border(sf::Vector2f(width * scale, height * scale));
+        border.setPosition(origin);
+        border.setFillColor(sf::Color(0, 0, 0, 160));
+        border.setOutlineColor(sf::Color(200, 200, 200));
+        border.setOutlineThickness(2);
+        window.draw(border);
+
+        sf::Sprite map(explored->getTexture());
+        map.setPosition(origin);
+        map.setScale(scale, scale);
+        window.draw(map);
+
+        sf::RectangleShape marker(sf::Vector2f(max(3.f, scale), max(3.f, scale)));
+        marker.setFillColor(sf::Color::Red);
+        marker.setPosition(origin.x + frame->playerX * scale, origin.y + frame->playerY * scale);
+        window.draw(marker);
+    }
+
+    sf::IntRect litCellRect() const {
+        sf::IntRect cells = visibleCellRect(world.getView(), width, height);
+        if (frame->fullView) return cells;
+        sf::IntRect around(frame->playerX - VIEW_RADIUS, frame->playerY - VIEW_RADIUS, 2 * VIEW_RADIUS + 1, 2 * VIEW_RADIUS + 1);
+        sf::IntRect both;
+        return cells.intersects(around, both) ? both : sf::IntRect();
+    }
+
+    void setPath(const vector<pair<int, int>>& path) {
+        if (path == currentPath) return;
+        currentPath = path;
+        sharedPath = make_shared<const vector<pair<int, int>>>(path);
+        pathVersion++;
+    }
+
+    float screenCellPixels() const {
+        return world.getSize().x / world.getView().getSize().x * TILE_SIZE;
+    }
+
+    void drawOverview() {
+        const unsigned limit = min(4096u, sf::Texture::getMaximumSize());
+        const int cellPixels = max(1, min<int>(TILE_SIZE, limit / max(width, height)));
+        if (cellPixels < LOD_CELL_PIXELS) {
+            pyramid->draw(world, screenCellPixels());
+            return;
+        }
+        sf::Vector2u size(width * cellPixels, height * cellPixels);
+        sf::RenderStates states;
+        states.transform.scale(float(cellPixels) / TILE_SIZE, float(cellPixels) / TILE_SIZE);
+        if (overview.getSize() != size || !overviewValid || overviewKeys != frame->playerKeys) {
+            if (overview.getSize() != size) {
+                overview.create(size.x, size.y);
+                overview.setSmooth(true);
+            }
+            overview.clear(sf::Color::Black);
+            mazeMesh->drawAll(overview, states);
+            drawItems(overview, sf::IntRect(0, 0, width, height), states);
+            overview.display();
+            overview.generateMipmap();
+            overviewValid = true;
+            overviewDirty.clear();
+            overviewKeys = frame->playerKeys;
+        } else if (!overviewDirty.empty()) {
+            mazeMesh->drawCells(overview, overviewDirty, states);
+            for (int cell : overviewDirty)
+                drawItems(overview, sf::IntRect(cell % width, cell / width, 1, 1), states);
+            overview.display();
+            overview.generateMipmap();
+            overviewDirty.clear();
+        }
+        sf::Sprite quad(overview.getTexture());
+        quad.setScale(float(TILE_SIZE) / cellPixels, float(TILE_SIZE) / cellPixels);
+        world.draw(quad);
+        drawDoors(world);
+    }
+
+    template <typename Target>
+    void drawDoors(Target& target, const sf::RenderStates& states = sf::RenderStates::Default) {
+        for (auto [x, y] : *frame->doors) {
+            if (!frame->fullView && !shownFov->isVisible(x, y)) continue;
+            doorRect.setPosition(x * TILE_SIZE + 4, y * TILE_SIZE + 4);
+            target.draw(doorRect, states);
+        }
+    }
+
+    template <typename Target>
+    void drawItems(Target& target, const sf::IntRect& cells, const sf::RenderStates& states = sf::RenderStates::Default) {
+        for (int y = cells.top; y < cells.top + cells.height; ++y) {
+            for (int x = cells.left; x < cells.left + cells.width; ++x) {
+                if (!frame->fullView && !shownFov->isVisible(x, y)) continue;
+                int item = shownMaze.getItem(x, y);
+                int color = item & ITEM_COLOR_MASK;
+                bool held = frame->playerKeys >> color & 1;
+                if ((item & ~ITEM_COLOR_MASK) == KEY_ITEM && !held) {
+                    keyRect.setFillColor(KEY_COLORS[color]);
+                    keyRect.setPosition(x * TILE_SIZE + TILE_SIZE / 4, y * TILE_SIZE + TILE_SIZE / 4);
+                    target.draw(keyRect, states);
+                } else if ((item & ~ITEM_COLOR_MASK) == LOCK_ITEM) {
+                    lockRect.setFillColor(held ? sf::Color::Transparent : KEY_COLORS[color]);
+                    lockRect.setOutlineColor(held ? KEY_COLORS[color] : sf::Color::Black);
+                    lockRect.setPosition(x * TILE_SIZE + 3, y * TILE_SIZE + 3);
+                    target.draw(lockRect, states);
+                } else if (item == COIN_ITEM) {
+                    coinShape.setPosition(x * TILE_SIZE + TILE_SIZE / 4, y * TILE_SIZE + TILE_SIZE / 4);
+                    target.draw(coinShape, states);
+                }
+            }
+        }
     }
 
     int clamp(int val, int minVal, int maxVal) {
@@ -529,8 +4103,247 @@ private:
     }
 };
 
-int main() {
-    Game game;
+void runPathBenchmarks() {
+    const char* layouts[] = {"perfect", "braided", "rooms"};
+    const char* backends[] = {"BFS", "A*", "JPS"};
+    const int queries = 20;
+
+    cout << "layout    size   backend   avg us/query\n";
+    for (int size : {61, 201, 501}) {
+        for (int layout = 0; layout < 3; ++layout) {
+            srand(12345 + size);
+            Maze maze(size, size);
+            maze.generate();
+            if (layout == 1) maze.braid(60);
+            if (layout == 2) {
+                maze.braid(30);
+                maze.carveRooms(size / 4, max(5, size / 8));
+            }
+
+            vector<pair<int, int>> starts;
+            while ((int)starts.size() < queries) {
+                int x = rand() % size, y = rand() % size;
+                if (!maze.isWall(x, y)) starts.push_back({x, y});
+            }
+
+            size_t expected[queries];
+            for (int b = 0; b < 3; ++b) {
+                auto t0 = chrono::steady_clock::now();
+                for (int q = 0; q < queries; ++q) {
+                    auto path = maze.findShortestPath(starts[q].first, starts[q].second, size - 2, size - 2,
+                                                      static_cast<PathBackend>(b));
+                    if (b == 0) expected[q] = path.size();
+                    else if (path.size() != expected[q]) cerr << "path length mismatch for " << backends[b] << "\n";
+                }
+                double us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count() / queries;
+                cout << layouts[layout] << string(10 - string(layouts[layout]).size(), ' ')
+                     << size << string(7 - to_string(size).size(), ' ')
+                     << backends[b] << string(10 - string(backends[b]).size(), ' ') << us << "\n";
+            }
+
+            maze.scatterTerrain();
+            auto t0 = chrono::steady_clock::now();
+            for (int q = 0; q < queries; ++q)
+                maze.findCheapestPath(starts[q].first, starts[q].second, size - 2, size - 2);
+            double us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count() / queries;
+            cout << layouts[layout] << string(10 - string(layouts[layout]).size(), ' ')
+                 << size << string(7 - to_string(size).size(), ' ') << "Dial      " << us << "\n";
+        }
+    }
+
+    cout << "\nrace      size   runners   avg ms/step   max ms/step\n";
+    for (int count : {50, 150, 300, 600}) {
+        const int size = 201, goal = (size - 2) * size + size - 2;
+        srand(12345 + count);
+        Maze maze(size, size);
+        maze.generate();
+        CooperativePlanner planner(maze, size - 2, size - 2, count);
+        vector<Runner> runners;
+        vector<char> taken(size * size, 0);
+        taken[size + 1] = taken[goal] = 1;
+        while ((int)runners.size() < count) {
+            int x = rand() % size, y = rand() % size;
+            if (maze.isWall(x, y) || taken[y * size + x]) continue;
+            taken[y * size + x] = 1;
+            runners.emplace_back((int)runners.size(), x, y);
+            planner.add(runners.back());
+        }
+
+        double total = 0, worst = 0;
+        int steps = 300, stray = 0;
+        for (int step = 0; step < steps; ++step) {
+            auto t0 = chrono::steady_clock::now();
+            planner.step(runners, 1, 1);
+            for (size_t i = 0; i < runners.size();) {
+                if (planner.hasArrived(runners[i])) {
+                    planner.remove(runners[i]);
+                    runners.erase(runners.begin() + i);
+                } else {
+                    ++i;
+                }
+            }
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+            total += ms;
+            worst = max(worst, ms);
+            stray = max(stray, planner.strayReservations(runners));
+        }
+        if (stray) cerr << "race planner leaked " << stray << " reservations\n";
+        cout << "perfect   " << size << string(7 - to_string(size).size(), ' ')
+             << count << string(10 - to_string(count).size(), ' ')
+             << total / steps << "   " << worst << "\n";
+    }
+
+    cout << "\nexplore   size   steps     avg us/step   max us/step\n";
+    for (int size : {1001, 4001}) {
+        srand(12345 + size);
+        Maze maze(size, size);
+        maze.generate();
+        FieldOfView view(maze, VIEW_RADIUS);
+        ExploreField explorer(maze);
+        int x = 1, y = 1, steps = 0;
+        double total = 0, worst = 0;
+        for (; steps < 100000; ++steps) {
+            auto t0 = chrono::steady_clock::now();
+            view.compute(x, y);
+            explorer.reveal(view);
+            explorer.repair(EXPLORE_REPAIR_BUDGET);
+            if (explorer.isSettled()) {
+                if (explorer.isDone(x, y)) break;
+                auto [dx, dy] = explorer.nextStep(x, y);
+                x += dx;
+                y += dy;
+            }
+            double us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count();
+            total += us;
+            worst = max(worst, us);
+        }
+        cout << "perfect   " << size << string(7 - to_string(size).size(), ' ')
+             << steps << string(10 - to_string(steps).size(), ' ')
+             << total / max(1, steps) << "   " << worst << "\n";
+    }
+
+    cout << "\nview      size   full scan us/frame   rect us/frame\n";
+    for (int size : {61, 251, 1001, 4001}) {
+        srand(12345 + size);
+        Maze maze(size, size);
+        maze.generate();
+        int px = size / 2 | 1, py = size / 2 | 1;
+        FieldOfView view(maze, VIEW_RADIUS);
+        view.compute(px, py);
+        sf::View camera(sf::FloatRect(0, 0, 1920, 1080));
+        camera.setCenter(px * TILE_SIZE, py * TILE_SIZE);
+        const int frames = 20;
+        volatile int touched = 0;
+
+        auto t0 = chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f) {
+            int cx = px + (f & 1) * 2;
+            for (int y = 0; y < size; ++y)
+                for (int x = 0; x < size; ++x)
+                    if (abs(y - py) <= VIEW_RADIUS && abs(x - cx) <= VIEW_RADIUS && !maze.isWall(x, y)) touched = touched + 1;
+        }
+        double fullUs = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count() / frames;
+
+        t0 = chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f) {
+            camera.setCenter((px + (f & 1) * 2) * TILE_SIZE, py * TILE_SIZE);
+            sf::IntRect cells = visibleCellRect(camera, size, size);
+            for (int y = cells.top; y < cells.top + cells.height; ++y)
+                for (int x = cells.left; x < cells.left + cells.width; ++x)
+                    if (view.isVisible(x, y) && !maze.isWall(x, y)) touched = touched + 1;
+        }
+        double rectUs = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count() / frames;
+        cout << "perfect   " << size << string(7 - to_string(size).size(), ' ')
+             << left << setw(21) << fullUs << rectUs << "\n";
+    }
+
+    cout << "\nmasks     size   ms/pass\n";
+    for (int size : {1001, 4001, 8001}) {
+        srand(12345 + size);
+        Maze maze(size, size);
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x)
+                maze.set(x, y, rand() % 3 ? WALL : PASS);
+        WallMasks masks(maze);
+        const int passes = 5;
+        auto t0 = chrono::steady_clock::now();
+        for (int i = 0; i < passes; ++i) masks.compute();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count() / passes;
+        cout << "random    " << size << string(7 - to_string(size).size(), ' ') << ms << "\n";
+    }
+
+    cout << "\ndecorate  size   ms     clashes\n";
+    for (int size : {251, 1001}) {
+        srand(12345 + size);
+        Maze maze(size, size);
+        maze.generate();
+        maze.braid(30);
+        auto t0 = chrono::steady_clock::now();
+        TileDecorator decorator(maze, maze.getSeed());
+        vector<uint8_t> variants = decorator.solve();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+        bool repeatable = TileDecorator(maze, maze.getSeed()).solve() == variants;
+        cout << "braided   " << size << string(7 - to_string(size).size(), ' ') << left << setw(7) << ms
+             << decorator.getContradictions() << (repeatable ? "" : " (not deterministic)") << "\n";
+    }
+
+    // Entities pace back and forth on an open floor so every one animates, for long enough that
+    // the slime frames actually advance.
+    cout << "\nsprites   count   us/frame  frames shown\n";
+    sf::Texture spriteAtlas;
+    spriteAtlas.create(TILE_SIZE * ENTITY_SLOTS, TILE_SIZE);
+    for (int count : {500, 5000, 20000}) {
+        Maze arena(1001, count / 1000 + 1);
+        for (int y = 0; y < arena.getHeight(); ++y)
+            for (int x = 0; x < arena.getWidth(); ++x)
+                arena.set(x, y, PASS);
+        vector<Player> entities;
+        for (int i = 0; i < count; ++i) entities.emplace_back(i % 1000, i / 1000);
+        SpriteBatch batch;
+        batch.setAtlas(spriteAtlas);
+        int frames = 0, shown = 0;
+        auto t0 = chrono::steady_clock::now();
+        while (frames < 100 || chrono::steady_clock::now() - t0 < chrono::seconds(1)) {
+            batch.clear();
+            for (Player& entity : entities) {
+                entity.move(frames % 2 ? -1 : 1, 0, arena);
+                entity.update();
+                entity.draw(batch);
+                shown |= 1 << entity.getFrame();
+            }
+            frames++;
+        }
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - t0).count() / frames;
+        int distinct = 0;
+        for (int bits = shown; bits; bits &= bits - 1) distinct++;
+        cout << "batch     " << left << setw(8) << count << setw(10) << us << distinct
+             << (batch.getSpriteCount() == (size_t)count ? "" : " (count mismatch)") << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench") {
+        runPathBenchmarks();
+        return 0;
+    }
+    int size = 61, scale = 1;
+    bool governor = false;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc)
+            size = max(11, atoi(argv[++i]) | 1);
+        else if (arg == "--scale" && i + 1 < argc)
+            scale = max(1, min(MAX_PIXEL_SCALE, atoi(argv[++i])));
+        else if (arg == "--governor")
+            governor = true;
+    }
+    // Fog, sight, the explored map and the shader's cell codes are each one texture per maze.
+    int largest = (static_cast<int>(sf::Texture::getMaximumSize()) - 1) | 1;
+    if (size > largest) {
+        std::cerr << "--size " << size << " exceeds the GPU texture limit, using " << largest << "\n";
+        size = largest;
+    }
+    Game game(size, scale, governor);
     game.run();
     return 0;
 }
\ No newline at end of file